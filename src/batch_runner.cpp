@@ -0,0 +1,136 @@
+#include "batch_runner.h"
+#include "perfsim.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <err.h>
+
+std::vector<BatchRunner::Job> BatchRunner::read_jobs(const char* file_name, const Config& base) {
+    std::ifstream in(file_name);
+    if (!in)
+        err(EXIT_FAILURE, "Can't open job list");
+
+    std::vector<Job> jobs;
+    std::string line;
+    for (size_t line_num = 1; std::getline(in, line); line_num++) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        Job job;
+        job.config = base;
+        if (!(fields >> job.file_name))
+            continue;
+        if (!(fields >> job.instructions))
+            errx(EXIT_FAILURE, "job list line %zu: expected FILE NUM_INSTRUCTIONS", line_num);
+        std::string assignment;
+        while (fields >> assignment)
+            job.config.set(assignment);
+        job.config.validate();
+        jobs.push_back(job);
+    }
+    return jobs;
+}
+
+std::vector<BatchRunner::Job> BatchRunner::expand_sweep(const Job& base, const std::vector<std::string>& axes) {
+    std::vector<Job> jobs = {base};
+    for (const auto& axis : axes) {
+        size_t pos = axis.find('=');
+        if (pos == std::string::npos)
+            errx(EXIT_FAILURE, "Expected KEY=V1,V2,...: %s", axis.c_str());
+        std::string key = axis.substr(0, pos);
+
+        std::vector<Job> expanded;
+        for (const auto& job : jobs) {
+            std::istringstream values(axis.substr(pos + 1));
+            std::string value;
+            while (std::getline(values, value, ',')) {
+                Job point = job;
+                point.config.set(key, value);
+                expanded.push_back(point);
+            }
+        }
+        jobs = std::move(expanded);
+    }
+    for (const auto& job : jobs)
+        job.config.validate();
+    return jobs;
+}
+
+// Programs are loaded up front on the calling thread; libelf keeps global
+// state, simulators do not.
+BatchRunner::BatchRunner(const std::vector<Job>& jobs, size_t num_threads):
+    jobs(jobs),
+    results(jobs.size()),
+    num_threads(num_threads)
+{
+    if (this->num_threads == 0)
+        this->num_threads = std::max(1u, std::thread::hardware_concurrency());
+    // Sweeps run the same program many times; load it once and share the
+    // pages, simulators copy them on write.
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (i > 0 && jobs[i].file_name == jobs[i - 1].file_name)
+            programs.push_back(programs.back());
+        else
+            programs.push_back(Checkpoint::load_program(jobs[i].file_name.c_str()));
+    }
+}
+
+void BatchRunner::run_job(size_t index) {
+    auto start = std::chrono::steady_clock::now();
+
+    Checkpoint& program = programs[index];
+    PerfSim psim(program.pages, program.PC, jobs[index].config);
+    if (program.is_restored)
+        psim.set_registers(program.registers);
+    psim.set_trace(false);
+    psim.set_visual(false);
+    psim.simulate(jobs[index].instructions);
+
+    results[index].stats = psim.get_stats();
+    results[index].icache = psim.get_icache_stats();
+    results[index].dcache = psim.get_dcache_stats();
+    results[index].seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void BatchRunner::run() {
+    std::atomic<size_t> next(0);
+    auto worker = [this, &next] {
+        for (size_t index = next++; index < jobs.size(); index = next++)
+            run_job(index);
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < std::min(num_threads, jobs.size()); i++)
+        threads.emplace_back(worker);
+    for (auto& thread : threads)
+        thread.join();
+
+    print_results();
+}
+
+void BatchRunner::print_results() const {
+    auto hit_rate = [](const Cache::Stats& stats) {
+        return stats.accesses ? 1.0 - double(stats.misses + stats.secondary_misses) / stats.accesses : 0;
+    };
+    std::cout << std::dec << "Jobs: " << jobs.size() << ", threads: " << num_threads << std::endl;
+    std::cout << std::left << std::setw(32) << "File" << std::right
+              << std::setw(14) << "Instructions" << std::setw(14) << "Cycles" << std::setw(10) << "CPI"
+              << std::setw(12) << "Data dep" << std::setw(12) << "Memory" << std::setw(12) << "Mispredict"
+              << std::setw(10) << "I$ hit" << std::setw(10) << "D$ hit"
+              << std::setw(10) << "Seconds" << "  Config" << std::endl;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const auto& stats = results[i].stats;
+        std::cout << std::left << std::setw(32) << jobs[i].file_name << std::right
+                  << std::setw(14) << stats.instructions << std::setw(14) << stats.cycles
+                  << std::setw(10) << std::fixed << std::setprecision(4)
+                  << (stats.instructions ? double(stats.cycles) / stats.instructions : 0)
+                  << std::setw(12) << stats.data_dependency << std::setw(12) << stats.memory
+                  << std::setw(12) << stats.mispredict
+                  << std::setw(10) << hit_rate(results[i].icache) << std::setw(10) << hit_rate(results[i].dcache)
+                  << std::setw(10) << std::setprecision(3) << results[i].seconds
+                  << std::defaultfloat << "  " << jobs[i].config.diff(Config()) << std::endl;
+    }
+}
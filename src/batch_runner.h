@@ -0,0 +1,50 @@
+#ifndef BATCH_RUNNER_H
+#define BATCH_RUNNER_H
+
+#include <string>
+#include <vector>
+
+#include "checkpoint.h"
+#include "hazard_unit.h"
+#include "cache.h"
+#include "config.h"
+
+// Runs independent PerfSim jobs on a pool of host threads and prints one
+// results table in job order.
+class BatchRunner {
+public:
+    struct Job {
+        std::string file_name;
+        uint32_t instructions = 0;
+        Config config;
+    };
+
+private:
+    struct Result {
+        HazardUnit::Stats stats;
+        Cache::Stats icache;
+        Cache::Stats dcache;
+        double seconds = 0;
+    };
+
+    std::vector<Job> jobs;
+    std::vector<Checkpoint> programs;
+    std::vector<Result> results;
+    size_t num_threads;
+
+    void run_job(size_t index);
+    void print_results() const;
+
+public:
+    // Job list: one "FILE NUM_INSTRUCTIONS [KEY=VALUE...]" per line on top
+    // of the base config, '#' starts a comment.
+    static std::vector<Job> read_jobs(const char* file_name, const Config& base);
+    // Cartesian product of "KEY=V1,V2,..." axes applied to the base job.
+    static std::vector<Job> expand_sweep(const Job& base, const std::vector<std::string>& axes);
+
+    // num_threads == 0 uses every host core.
+    BatchRunner(const std::vector<Job>& jobs, size_t num_threads);
+    void run();
+};
+
+#endif
@@ -0,0 +1,363 @@
+#include "branch_predictor.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <stdexcept>
+
+const char* const DirectionPredictor::names[MAX] = { "NONE", "STATIC", "BIMODAL", "GSHARE", "TAGE" };
+
+namespace {
+
+uint32_t log2(uint32_t x) {
+    uint32_t result = 0;
+    while (x >>= 1)
+        result++;
+    return result;
+}
+
+void train(uint8_t& counter, bool is_taken) {
+    if (is_taken && counter < 3)
+        counter++;
+    else if (!is_taken && counter > 0)
+        counter--;
+}
+
+}
+
+std::unique_ptr<DirectionPredictor> DirectionPredictor::create(uint32_t kind, uint32_t num_entries, uint32_t history_length) {
+    switch (kind) {
+        case NONE:    return nullptr;
+        case STATIC:  return std::make_unique<StaticPredictor>();
+        case BIMODAL: return std::make_unique<BimodalPredictor>(num_entries);
+        case GSHARE:  return std::make_unique<GsharePredictor>(num_entries, history_length);
+        case TAGE:    return std::make_unique<TagePredictor>(num_entries, history_length);
+        default:      throw std::invalid_argument("Unknown branch predictor");
+    }
+}
+
+uint32_t DirectionPredictor::fold(uint64_t history, uint32_t history_length, uint32_t num_bits) {
+    if (history_length < 64)
+        history &= (uint64_t(1) << history_length) - 1;
+    uint32_t result = 0;
+    for (; history != 0; history >>= num_bits)
+        result ^= history & ((1u << num_bits) - 1);
+    return result;
+}
+
+bool BimodalPredictor::predict(uint32_t PC, uint32_t /* target */, uint64_t /* history */) {
+    return counters[(PC >> 2) % counters.size()] >= 2;
+}
+
+void BimodalPredictor::update(uint32_t PC, uint32_t /* target */, uint64_t /* history */, bool is_taken) {
+    train(counters[(PC >> 2) % counters.size()], is_taken);
+}
+
+GsharePredictor::GsharePredictor(uint32_t num_entries, uint32_t history_length) :
+    DirectionPredictor(GSHARE),
+    counters(num_entries, 1),
+    index_bits(log2(num_entries)),
+    history_length(history_length)
+{}
+
+uint32_t GsharePredictor::get_index(uint32_t PC, uint64_t history) const {
+    return ((PC >> 2) ^ fold(history, history_length, index_bits)) % counters.size();
+}
+
+bool GsharePredictor::predict(uint32_t PC, uint32_t /* target */, uint64_t history) {
+    return counters[get_index(PC, history)] >= 2;
+}
+
+void GsharePredictor::update(uint32_t PC, uint32_t /* target */, uint64_t history, bool is_taken) {
+    train(counters[get_index(PC, history)], is_taken);
+}
+
+TagePredictor::TagePredictor(uint32_t num_entries, uint32_t history_length) :
+    DirectionPredictor(TAGE),
+    base(num_entries),
+    index_bits(log2(num_entries))
+{
+    for (uint32_t i = 0; i < NUM_TABLES; i++) {
+        tables[i].resize(num_entries);
+        history_lengths[i] = std::max(history_length >> (NUM_TABLES - 1 - i), 1u);
+    }
+}
+
+TagePredictor::Lookup TagePredictor::lookup(uint32_t PC, uint32_t target, uint64_t history) {
+    Lookup result;
+    for (uint32_t i = NUM_TABLES; i-- > 0;) {
+        const uint32_t length = history_lengths[i];
+        result.indices[i] = ((PC >> 2) ^ (PC >> (2 + index_bits)) ^ fold(history, length, index_bits)) % tables[i].size();
+        result.tags[i] = ((PC >> 2) ^ fold(history, length, TAG_BITS) ^ (fold(history, length, TAG_BITS - 1) << 1)) & ((1u << TAG_BITS) - 1);
+
+        const Entry& entry = tables[i][result.indices[i]];
+        if (!entry.is_valid || entry.tag != result.tags[i])
+            continue;
+        if (result.provider == NUM_TABLES)
+            result.provider = i;
+        else if (result.alternate == NUM_TABLES)
+            result.alternate = i;
+    }
+
+    result.alternate_prediction = result.alternate == NUM_TABLES
+        ? base.predict(PC, target, history)
+        : tables[result.alternate][result.indices[result.alternate]].counter >= 0;
+    if (result.provider == NUM_TABLES) {
+        result.prediction = result.alternate_prediction;
+        return result;
+    }
+
+    const Entry& entry = tables[result.provider][result.indices[result.provider]];
+    result.provider_prediction = entry.counter >= 0;
+    // A new entry that is still weak has not proven itself yet.
+    const bool is_weak = entry.counter == 0 || entry.counter == -1;
+    result.prediction = (is_weak && entry.useful == 0) ? result.alternate_prediction : result.provider_prediction;
+    return result;
+}
+
+bool TagePredictor::predict(uint32_t PC, uint32_t target, uint64_t history) {
+    return lookup(PC, target, history).prediction;
+}
+
+void TagePredictor::update(uint32_t PC, uint32_t target, uint64_t history, bool is_taken) {
+    const Lookup result = lookup(PC, target, history);
+
+    if (++updates % RESET_PERIOD == 0)
+        for (auto& table : tables)
+            for (auto& entry : table)
+                entry.useful >>= 1;
+
+    if (result.provider == NUM_TABLES)
+        base.update(PC, target, history, is_taken);
+    else {
+        Entry& entry = tables[result.provider][result.indices[result.provider]];
+        if (result.provider_prediction != result.alternate_prediction) {
+            if (result.provider_prediction == is_taken && entry.useful < 3)
+                entry.useful++;
+            else if (result.provider_prediction != is_taken && entry.useful > 0)
+                entry.useful--;
+        }
+        if (is_taken && entry.counter < 3)
+            entry.counter++;
+        else if (!is_taken && entry.counter > -4)
+            entry.counter--;
+    }
+
+    if (result.prediction == is_taken)
+        return;
+
+    // Allocate in the first longer table with a useless entry, or age
+    // them all so that a later misprediction finds one.
+    const uint32_t first = result.provider == NUM_TABLES ? 0 : result.provider + 1;
+    for (uint32_t i = first; i < NUM_TABLES; i++) {
+        Entry& entry = tables[i][result.indices[i]];
+        if (entry.useful == 0) {
+            entry.tag = result.tags[i];
+            entry.counter = is_taken ? 0 : -1;
+            entry.is_valid = true;
+            return;
+        }
+    }
+    for (uint32_t i = first; i < NUM_TABLES; i++) {
+        Entry& entry = tables[i][result.indices[i]];
+        entry.useful--;
+    }
+}
+
+bool ReturnAddressStack::push(uint32_t addr) {
+    if (entries.empty())
+        return false;
+    entries[top] = addr;
+    top = (top + 1) % entries.size();
+    if (size < entries.size()) {
+        size++;
+        return false;
+    }
+    return true;
+}
+
+bool ReturnAddressStack::pop(uint32_t& addr) {
+    if (size == 0)
+        return false;
+    top = (top + entries.size() - 1) % entries.size();
+    size--;
+    addr = entries[top];
+    return true;
+}
+
+void ReturnAddressStack::save(Instruction::Prediction& prediction) const {
+    prediction.ras_top = top;
+    prediction.ras_size = size;
+    if (!entries.empty())
+        prediction.ras_value = entries[(top + entries.size() - 1) % entries.size()];
+}
+
+void ReturnAddressStack::restore(const Instruction::Prediction& prediction) {
+    if (entries.empty())
+        return;
+    top = prediction.ras_top;
+    size = prediction.ras_size;
+    entries[(top + entries.size() - 1) % entries.size()] = prediction.ras_value;
+}
+
+BranchPredictor::BranchPredictor(uint32_t kind, uint32_t btb_entries, uint32_t num_entries, uint32_t history_length, uint32_t ras_depth) :
+    direction(DirectionPredictor::create(kind, num_entries, history_length)),
+    btb(btb_entries),
+    ras(ras_depth)
+{}
+
+BranchPredictor::Kind BranchPredictor::get_kind(const Instruction& instr) {
+    if (instr.is_branch())
+        return Kind::BRANCH;
+    if (instr.is_return())
+        return Kind::RETURN;
+    if (instr.is_call())
+        return Kind::CALL;
+    return Kind::JUMP;
+}
+
+void BranchPredictor::push_return_address(uint32_t addr) {
+    if (ras.push(addr))
+        stats.ras_overflows++;
+}
+
+bool BranchPredictor::pop_return_address(uint32_t& addr) {
+    if (ras.pop(addr))
+        return true;
+    if (ras.get_depth() != 0)
+        stats.ras_underflows++;
+    return false;
+}
+
+BranchPredictor::Prediction BranchPredictor::predict(uint32_t PC) {
+    Prediction prediction;
+    prediction.next_PC = PC + 4;
+    prediction.history = history;
+    ras.save(prediction);
+    const BTBEntry& entry = get_btb_entry(PC);
+    if (entry.PC != PC)
+        return prediction;
+
+    switch (entry.kind) {
+        case Kind::BRANCH: {
+            const bool is_taken = direction->predict(PC, entry.target, history);
+            if (is_taken)
+                prediction.next_PC = entry.target;
+            history = (history << 1) | is_taken;
+            break;
+        }
+        case Kind::JUMP:
+            prediction.next_PC = entry.target;
+            break;
+        case Kind::CALL:
+            prediction.next_PC = entry.target;
+            push_return_address(PC + 4);
+            break;
+        case Kind::RETURN:
+            // An empty stack leaves the last target the BTB saw.
+            if (!pop_return_address(prediction.next_PC))
+                prediction.next_PC = entry.target;
+            break;
+    }
+    return prediction;
+}
+
+void BranchPredictor::update(const Instruction& instr) {
+    const uint32_t PC = instr.get_PC();
+    const uint32_t target = instr.get_new_PC();
+    const bool is_taken = target != PC + 4;
+    const bool is_mispredict = target != instr.get_predicted_PC();
+
+    BTBEntry& entry = get_btb_entry(PC);
+    const bool is_btb_hit = entry.PC == PC;
+
+    Site& site = sites[PC];
+    site.executed++;
+    site.taken += is_taken;
+    site.mispredicts += is_mispredict;
+
+    if (instr.is_branch()) {
+        stats.branches++;
+        direction->update(PC, is_btb_hit ? entry.target : target, instr.get_prediction().history, is_taken);
+        if (is_mispredict && is_btb_hit)
+            stats.direction_mispredicts++;
+        else if (is_mispredict)
+            stats.target_mispredicts++;
+    } else {
+        stats.jumps++;
+        stats.target_mispredicts += is_mispredict;
+    }
+    if (instr.is_return()) {
+        stats.returns++;
+        stats.return_mispredicts += is_mispredict;
+    }
+
+    if (is_taken)
+        entry = BTBEntry{PC, target, get_kind(instr)};
+
+    // Younger instructions are flushed, so is the history they added and
+    // the return addresses they pushed or popped. This one is replayed
+    // as it resolved.
+    if (is_mispredict) {
+        const Prediction& prediction = instr.get_prediction();
+        history = prediction.history;
+        if (instr.is_branch())
+            history = (history << 1) | is_taken;
+        ras.restore(prediction);
+        uint32_t addr = 0;
+        if (instr.is_call())
+            ras.push(PC + 4);
+        else if (instr.is_return())
+            ras.pop(addr);
+    }
+}
+
+void BranchPredictor::train(Instruction& instr) {
+    instr.set_prediction(predict(instr.get_PC()));
+    update(instr);
+}
+
+void BranchPredictor::warm_up(const BranchPredictor& warmer) {
+    assert(btb.size() == warmer.btb.size());
+    assert(ras.get_depth() == warmer.ras.get_depth());
+    direction = warmer.direction != nullptr ? warmer.direction->clone() : nullptr;
+    btb = warmer.btb;
+    history = warmer.history;
+    ras = warmer.ras;
+    stats = Stats();
+    sites.clear();
+}
+
+void BranchPredictor::print_stats(uint32_t instructions) const {
+    if (!is_enabled())
+        return;
+    const uint64_t predicted = stats.branches + stats.jumps;
+    const uint64_t mispredicts = stats.direction_mispredicts + stats.target_mispredicts;
+    std::cout << std::dec << "Branch predictor: " << direction->get_name() << ", BTB entries: " << btb.size()
+              << ", branches: " << stats.branches << ", jumps: " << stats.jumps
+              << ", direction mispredicts: " << stats.direction_mispredicts
+              << ", target mispredicts: " << stats.target_mispredicts
+              << ", accuracy: " << (predicted ? (predicted - mispredicts) * 1.0 / predicted : 0)
+              << ", MPKI: " << (instructions ? mispredicts * 1000.0 / instructions : 0) << std::endl;
+
+    const uint32_t MAX_SITES = 5;
+    std::vector<std::pair<uint32_t, Site>> worst;
+    for (const auto& site : sites)
+        if (site.second.mispredicts != 0)
+            worst.push_back(site);
+    std::sort(worst.begin(), worst.end(), [](const auto& a, const auto& b) {
+        return a.second.mispredicts != b.second.mispredicts ? a.second.mispredicts > b.second.mispredicts : a.first < b.first;
+    });
+    if (worst.size() > MAX_SITES)
+        worst.resize(MAX_SITES);
+    for (const auto& [PC, site] : worst)
+        std::cout << "    0x" << std::hex << PC << std::dec << ": executed: " << site.executed << ", taken: " << site.taken
+                  << ", mispredicts: " << site.mispredicts << std::endl;
+
+    if (ras.get_depth() == 0)
+        return;
+    std::cout << "Return address stack: " << ras.get_depth() << " entries, returns: " << stats.returns
+              << ", mispredicts: " << stats.return_mispredicts
+              << ", accuracy: " << (stats.returns ? (stats.returns - stats.return_mispredicts) * 1.0 / stats.returns : 0)
+              << ", overflows: " << stats.ras_overflows << ", underflows: " << stats.ras_underflows << std::endl;
+}
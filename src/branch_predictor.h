@@ -0,0 +1,236 @@
+#ifndef BRANCH_PREDICTOR_H
+#define BRANCH_PREDICTOR_H
+
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "instruction.h"
+
+// Direction predictor for conditional branches. It sees only what fetch
+// knows before decode: the PC, the target the BTB holds and the global
+// history of the branches predicted before.
+class DirectionPredictor {
+public:
+    enum Kind : uint32_t {
+        NONE,
+        STATIC,
+        BIMODAL,
+        GSHARE,
+        TAGE,
+        MAX
+    };
+    static const char* const names[MAX];
+
+    // Returns nullptr for NONE.
+    static std::unique_ptr<DirectionPredictor> create(uint32_t kind, uint32_t num_entries, uint32_t history_length);
+
+    virtual ~DirectionPredictor() = default;
+    virtual std::unique_ptr<DirectionPredictor> clone() const = 0;
+
+    virtual bool predict(uint32_t PC, uint32_t target, uint64_t history) = 0;
+    // Called with the history the prediction was made with.
+    virtual void update(uint32_t PC, uint32_t target, uint64_t history, bool is_taken) = 0;
+
+    const char* get_name() const { return names[kind]; }
+
+protected:
+    uint32_t kind;
+
+    explicit DirectionPredictor(uint32_t kind) : kind(kind) {}
+
+    // XOR of the history_length youngest history bits taken num_bits at a time.
+    static uint32_t fold(uint64_t history, uint32_t history_length, uint32_t num_bits);
+};
+
+// Backward taken, forward not taken.
+class StaticPredictor : public DirectionPredictor {
+public:
+    StaticPredictor() : DirectionPredictor(STATIC) {}
+    std::unique_ptr<DirectionPredictor> clone() const override { return std::make_unique<StaticPredictor>(*this); }
+    bool predict(uint32_t PC, uint32_t target, uint64_t /* history */) override { return target < PC; }
+    void update(uint32_t /* PC */, uint32_t /* target */, uint64_t /* history */, bool /* is_taken */) override {}
+};
+
+// Two-bit saturating counters indexed by the PC.
+class BimodalPredictor : public DirectionPredictor {
+private:
+    std::vector<uint8_t> counters;
+
+public:
+    explicit BimodalPredictor(uint32_t num_entries) : DirectionPredictor(BIMODAL), counters(num_entries, 1) {}
+    std::unique_ptr<DirectionPredictor> clone() const override { return std::make_unique<BimodalPredictor>(*this); }
+    bool predict(uint32_t PC, uint32_t target, uint64_t history) override;
+    void update(uint32_t PC, uint32_t target, uint64_t history, bool is_taken) override;
+};
+
+// Two-bit counters indexed by the PC XOR the folded global history.
+class GsharePredictor : public DirectionPredictor {
+private:
+    std::vector<uint8_t> counters;
+    uint32_t index_bits;
+    uint32_t history_length;
+
+    uint32_t get_index(uint32_t PC, uint64_t history) const;
+
+public:
+    GsharePredictor(uint32_t num_entries, uint32_t history_length);
+    std::unique_ptr<DirectionPredictor> clone() const override { return std::make_unique<GsharePredictor>(*this); }
+    bool predict(uint32_t PC, uint32_t target, uint64_t history) override;
+    void update(uint32_t PC, uint32_t target, uint64_t history, bool is_taken) override;
+};
+
+// A bimodal base table under tagged tables of geometrically growing
+// history lengths, the longest being history_length. The longest
+// matching table provides the prediction unless its entry is new and
+// still weak; a misprediction allocates an entry in a longer table.
+class TagePredictor : public DirectionPredictor {
+private:
+    static const uint32_t NUM_TABLES = 4;
+    static const uint32_t TAG_BITS = 9;
+    // Usefulness counters age by half this often.
+    static const uint32_t RESET_PERIOD = 1u << 18;
+
+    struct Entry {
+        uint16_t tag = 0;
+        // Three-bit signed counter, taken when not negative.
+        int8_t counter = 0;
+        uint8_t useful = 0;
+        bool is_valid = false;
+    };
+
+    // The tables that hit for one prediction, NUM_TABLES if none.
+    struct Lookup {
+        uint32_t provider = NUM_TABLES;
+        uint32_t alternate = NUM_TABLES;
+        std::array<uint32_t, NUM_TABLES> indices;
+        std::array<uint16_t, NUM_TABLES> tags;
+        bool provider_prediction = false;
+        bool alternate_prediction = false;
+        bool prediction = false;
+    };
+
+    BimodalPredictor base;
+    std::array<std::vector<Entry>, NUM_TABLES> tables;
+    std::array<uint32_t, NUM_TABLES> history_lengths;
+    uint32_t index_bits;
+    uint32_t updates = 0;
+
+    Lookup lookup(uint32_t PC, uint32_t target, uint64_t history);
+
+public:
+    TagePredictor(uint32_t num_entries, uint32_t history_length);
+    std::unique_ptr<DirectionPredictor> clone() const override { return std::make_unique<TagePredictor>(*this); }
+    bool predict(uint32_t PC, uint32_t target, uint64_t history) override;
+    void update(uint32_t PC, uint32_t target, uint64_t history, bool is_taken) override;
+};
+
+// Return addresses of the calls in flight, pushed and popped at fetch.
+// Pushing onto a full stack overwrites the oldest address; popping an
+// empty one fails and leaves the return to the BTB.
+class ReturnAddressStack {
+public:
+    explicit ReturnAddressStack(uint32_t depth) : entries(depth) {}
+
+    uint32_t get_depth() const { return entries.size(); }
+
+    // Returns whether the oldest address was lost.
+    bool push(uint32_t addr);
+    bool pop(uint32_t& addr);
+
+    // The top and its address are enough to undo the pushes and pops
+    // made on a wrong path since.
+    void save(Instruction::Prediction& prediction) const;
+    void restore(const Instruction::Prediction& prediction);
+
+private:
+    std::vector<uint32_t> entries;
+    // Slot of the next push.
+    uint32_t top = 0;
+    uint32_t size = 0;
+};
+
+// Fetch-stage branch prediction: a direct-mapped BTB tells which PCs are
+// branches, jumps, calls or returns and where they go, the direction
+// predictor decides whether a conditional branch is taken and the return
+// address stack where a return goes. Branches are looked up by PC alone,
+// so one the BTB has not seen taken falls through.
+class BranchPredictor {
+public:
+    struct Stats {
+        uint64_t branches = 0;
+        uint64_t jumps = 0;
+        // Conditional branches the BTB knew going the other way than
+        // predicted.
+        uint64_t direction_mispredicts = 0;
+        // Jumps sent to a wrong target, and jumps and taken branches the
+        // BTB did not know.
+        uint64_t target_mispredicts = 0;
+        // Returns are also counted as jumps.
+        uint64_t returns = 0;
+        uint64_t return_mispredicts = 0;
+        // Counted at fetch, wrong paths included.
+        uint64_t ras_overflows = 0;
+        uint64_t ras_underflows = 0;
+    };
+
+    using Prediction = Instruction::Prediction;
+
+    // A NONE direction predictor turns the unit off: fetch always goes on
+    // to PC + 4. A ras_depth of 0 leaves returns to the BTB.
+    BranchPredictor(uint32_t kind, uint32_t btb_entries, uint32_t num_entries, uint32_t history_length, uint32_t ras_depth);
+
+    bool is_enabled() const { return direction != nullptr; }
+
+    Prediction predict(uint32_t PC);
+    // Trains on a resolved jump or branch and repairs the history and
+    // the return address stack after a misprediction.
+    void update(const Instruction& instr);
+    // Predicts and updates on an executed jump or branch in program
+    // order, for functional warm-up during fast-forward.
+    void train(Instruction& instr);
+    // Takes the tables, history and return addresses of a trained copy
+    // with the same parameters; the statistics start from zero.
+    void warm_up(const BranchPredictor& warmer);
+
+    Stats get_stats() const { return stats; }
+    void print_stats(uint32_t instructions) const;
+
+private:
+    enum class Kind {
+        BRANCH,
+        JUMP,
+        CALL,
+        RETURN
+    };
+
+    struct BTBEntry {
+        uint32_t PC = NO_VAL32;
+        uint32_t target = 0;
+        Kind kind = Kind::BRANCH;
+    };
+
+    // Per-PC counts for the branches that cost the most.
+    struct Site {
+        uint64_t executed = 0;
+        uint64_t taken = 0;
+        uint64_t mispredicts = 0;
+    };
+
+    std::unique_ptr<DirectionPredictor> direction;
+    std::vector<BTBEntry> btb;
+    // Speculative global history, youngest branch in bit 0.
+    uint64_t history = 0;
+    ReturnAddressStack ras;
+    Stats stats;
+    std::unordered_map<uint32_t, Site> sites;
+
+    BTBEntry& get_btb_entry(uint32_t PC) { return btb[(PC >> 2) % btb.size()]; }
+    static Kind get_kind(const Instruction& instr);
+    // Pushes or pops for a call or return, counting what is lost.
+    void push_return_address(uint32_t addr);
+    bool pop_return_address(uint32_t& addr);
+};
+
+#endif
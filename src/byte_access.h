@@ -0,0 +1,62 @@
+#ifndef BYTE_ACCESS_H
+#define BYTE_ACCESS_H
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+// Little-endian guest values in host byte buffers. The width-templated
+// accessors compile to a single load or store; the byte-wise ones are the
+// reference the simulator used before and are kept for benchmarking.
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "guest memory is accessed with host loads");
+
+template <size_t N> struct AccessWidth;
+template <> struct AccessWidth<1> { using type = uint8_t; };
+template <> struct AccessWidth<2> { using type = uint16_t; };
+template <> struct AccessWidth<4> { using type = uint32_t; };
+
+template <size_t N>
+inline uint32_t load_bytes(const uint8_t* ptr) {
+    typename AccessWidth<N>::type value;
+    std::memcpy(&value, ptr, N);
+    return value;
+}
+
+template <size_t N>
+inline void store_bytes(uint8_t* ptr, uint32_t value) {
+    auto narrow = static_cast<typename AccessWidth<N>::type>(value);
+    std::memcpy(ptr, &narrow, N);
+}
+
+inline uint32_t load_bytewise(const uint8_t* ptr, size_t num_bytes) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < num_bytes; ++i)
+        value |= static_cast<uint32_t>(ptr[i]) << (8*i);
+    return value;
+}
+
+inline void store_bytewise(uint8_t* ptr, uint32_t value, size_t num_bytes) {
+    for (size_t i = 0; i < num_bytes; ++i)
+        ptr[i] = static_cast<uint8_t>(value >> 8*i);
+}
+
+// Run-time width, dispatched to the fixed-width accessors.
+inline uint32_t load_bytes(const uint8_t* ptr, size_t num_bytes) {
+    switch (num_bytes) {
+        case 1: return load_bytes<1>(ptr);
+        case 2: return load_bytes<2>(ptr);
+        case 4: return load_bytes<4>(ptr);
+        default: return load_bytewise(ptr, num_bytes);
+    }
+}
+
+inline void store_bytes(uint8_t* ptr, uint32_t value, size_t num_bytes) {
+    switch (num_bytes) {
+        case 1: store_bytes<1>(ptr, value); break;
+        case 2: store_bytes<2>(ptr, value); break;
+        case 4: store_bytes<4>(ptr, value); break;
+        default: store_bytewise(ptr, value, num_bytes); break;
+    }
+}
+
+#endif
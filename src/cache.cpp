@@ -1,162 +1,395 @@
 #include "cache.h"
+#include <algorithm>
+#include <cstring>
 #include <sstream>
 
-uint32_t Cache::Line::read_bytes(uint32_t offset, uint32_t num_bytes) {
-    uint32_t value = 0;
-    for (uint i = 0; i < num_bytes; ++i) {
-        uint8_t byte = data[offset + i];
-        value |= static_cast<uint32_t>(byte) << (8*i);
-    }
-    return value;
-}
-
-void Cache::Line::write_bytes(uint32_t value, uint32_t offset, uint32_t num_bytes) {
-    for (uint i = 0; i < num_bytes; ++i) {
-        uint8_t byte = static_cast<uint8_t>(value >> 8*i); 
-        data[offset + i] = byte;
-    }
-}
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-Cache::Cache(PerfsimMemory& memory, uint32_t num_ways, uint32_t num_sets, uint32_t line_size_in_bytes)
+Cache::Cache(const Memory& memory, LinePort& next_level, uint32_t num_ways, uint32_t num_sets, uint32_t line_size_in_bytes,
+             uint32_t policy, bool is_critical_word_first, uint32_t num_mshrs, uint32_t prefetcher, uint32_t prefetch_degree)
     : memory(memory)
+    , next_level(next_level)
+    , num_ways(num_ways)
     , num_sets(num_sets)
     , line_size_in_bytes(line_size_in_bytes)
-    , cache_mem(num_ways, std::vector<Line>(num_sets, Line(line_size_in_bytes)))
-    , fifo_queues(num_sets, std::queue<uint32_t>())
-    {
-        for (auto i = 0; i < num_sets; i++) 
-            for (auto j = 0; j < num_ways; j++) 
-                fifo_queues[i].push(j);
-    }
+    , tags(size_t(num_sets) * num_ways, 0)
+    , data(size_t(num_sets) * num_ways * line_size_in_bytes)
+    , policy(ReplacementPolicy::create(policy, num_sets, num_ways))
+    , is_critical_word_first(is_critical_word_first)
+    , prefetcher(Prefetcher::create(prefetcher, line_size_in_bytes, prefetch_degree))
+    , prefetched(size_t(num_sets) * num_ways, 0)
+    , is_blocking(num_mshrs == 0)
+    , mshrs(std::max(num_mshrs, 1u))
+    {}
 
 
 void Cache::process_line_requests() {
     if (line_requests.empty())
         return;
 
-    if (memory.is_busy())
-        return;
-
     auto& line_request = line_requests.front();
-    Line& line = cache_mem[line_request.way][line_request.set];
+    Mshr& mshr = mshrs[line_request.mshr];
+    uint8_t* line = get_line_data(mshr.set, mshr.way);
 
-    if (line_request.awaiting_memory_request) {
-        auto mr = memory.get_request_status();
-        
+    if (!line_request.is_sent) {
+        // The other cache may own the bus.
+        if (next_level.is_busy())
+            return;
         if (line_request.request_type == request_type::read)
-            line.write_bytes(mr.data, line_request.bytes_processed, 2);
-
-        line_request.awaiting_memory_request = false;
-        line_request.bytes_processed += 2;
+            next_level.send_read_burst(mshr.addr, line, line_size_in_bytes, mshr.first_offset);
+        else
+            next_level.send_write_burst(mshr.victim_addr, line, line_size_in_bytes, mshr.is_victim_dirty);
+        line_request.is_sent = true;
+        return;
     }
 
-    if (line_request.bytes_processed == line.data.size()) {
-        if (line_request.request_type == request_type::read) {
-            line.is_valid = true;
-            line.addr = line_request.addr;
-            line.is_dirty = false;
-        }
-        else {
-            line.is_valid = true;
-            line.is_dirty = false;
+    if (!next_level.get_burst_status().is_completed)
+        return;
+
+    if (line_request.request_type == request_type::read) {
+        uint32_t& tag = tags[get_index(mshr.set, mshr.way)];
+        tag = make_tag_entry(mshr.addr, VALID);
+        prefetched[get_index(mshr.set, mshr.way)] = mshr.is_prefetch;
+        for (uint32_t i = 0; i < mshr.num_stores; i++) {
+            const auto& store = mshr.stores[i];
+            store_bytes(line + store.offset, store.value, store.num_bytes);
+            tag |= DIRTY;
         }
+        mshr.is_valid = false;
+        active_mshrs--;
+    }
+    else {
+        mshr.is_writing_back = false;
+    }
+
+    next_level.release();
+    line_requests.pop();
 
-        line_requests.pop();
+    process_line_requests(); 
+}
+
+// Serves a read from the line being filled once the beats holding it
+// have arrived, before the rest of the burst. Lines with merged stores
+// wait for the whole fill so the stores are seen.
+bool Cache::read_from_fill() {
+    const auto& line_request = line_requests.front();
+    const Mshr& fill = mshrs[line_request.mshr];
+    if (line_request.request_type != request_type::read || !line_request.is_sent
+        || fill.addr != get_line_addr(request.addr) || fill.num_stores != 0)
+        return false;
+
+    const uint32_t offset = get_line_offset(request.addr);
+    const uint32_t position = (offset + line_size_in_bytes - fill.first_offset) % line_size_in_bytes;
+    if (position + request.num_bytes > next_level.get_burst_status().bytes_done)
+        return false;
 
-        process_line_requests(); 
+    request.data = load_bytes(get_line_data(fill.set, fill.way) + offset, request.num_bytes);
+    return true;
+}
+
+// A line is busy while it is being fetched, and while it is the victim
+// being written back: fetching it again before that would read stale data.
+Cache::Mshr* Cache::find_mshr(uint32_t line_addr) {
+    for (auto& mshr : mshrs) {
+        if (!mshr.is_valid)
+            continue;
+        if (mshr.addr == line_addr || (mshr.is_writing_back && mshr.victim_addr == line_addr))
+            return &mshr;
     }
-    else if (!line_request.awaiting_memory_request) {
-        // send requests to memory
-        if (line_request.request_type == request_type::read)
-            memory.send_read_request(line_request.addr + line_request.bytes_processed, 2);
-        else
-            memory.send_write_request(line.read_bytes(line_request.bytes_processed, 2),
-                                            line_request.addr + line_request.bytes_processed, 2);
-        line_request.awaiting_memory_request = true;
+    return nullptr;
+}
+
+bool Cache::is_reserved(uint32_t set, uint32_t way) const {
+    for (const auto& mshr : mshrs)
+        if (mshr.is_valid && mshr.set == set && mshr.way == way)
+            return true;
+    return false;
+}
+
+bool Cache::merge_store(Mshr& mshr) {
+    if (mshr.num_stores == MAX_MERGED_STORES)
+        return false;
+    mshr.stores[mshr.num_stores++] = {get_line_offset(request.addr), request.num_bytes, request.data};
+    return true;
+}
+
+// Reserves a way for the missing line and queues its bursts. Fails when
+// all MSHRs are taken or every way of the set is already reserved.
+Cache::Mshr* Cache::allocate_mshr(uint32_t addr, bool is_prefetch) {
+    if (active_mshrs == mshrs.size())
+        return nullptr;
+
+    const uint32_t set = get_set(addr);
+    const uint32_t* set_tags = &tags[get_index(set, 0)];
+    uint32_t way = 0;
+    while (way < num_ways && ((set_tags[way] & VALID) || is_reserved(set, way)))
+        way++;
+    if (way == num_ways) {
+        way = policy->get_victim(set);
+        for (uint32_t i = 0; i < num_ways && is_reserved(set, way); i++)
+            way = (way + 1) % num_ways;
+        if (is_reserved(set, way))
+            return nullptr;
+    }
+    policy->on_fill(set, way);
+
+    uint32_t index = 0;
+    while (mshrs[index].is_valid)
+        index++;
+    Mshr& mshr = mshrs[index];
+    mshr = Mshr();
+    mshr.is_valid = true;
+    mshr.is_prefetch = is_prefetch;
+    mshr.addr = get_line_addr(addr);
+    mshr.set = set;
+    mshr.way = way;
+    if (is_critical_word_first) {
+        mshr.first_offset = get_line_offset(addr);
+        mshr.first_offset -= mshr.first_offset % next_level.get_bus_width();
+    }
+    active_mshrs++;
+
+    // The victim stops hitting now; its data stays in the way until the
+    // write-back has read it. An exclusive next level takes clean victims
+    // as well.
+    uint32_t& tag = tags[get_index(set, way)];
+    if ((tag & VALID) && prefetched[get_index(set, way)]) {
+        prefetched[get_index(set, way)] = 0;
+        stats.unused_prefetches++;
     }
+    if ((tag & VALID) && ((tag & DIRTY) || next_level.is_exclusive())) {
+        mshr.is_writing_back = true;
+        mshr.is_victim_dirty = tag & DIRTY;
+        mshr.victim_addr = get_entry_addr(tag);
+        line_requests.push(LineRequest(index, request_type::write));
+        stats.writebacks += mshr.is_victim_dirty;
+    }
+    tag = 0;
+    line_requests.push(LineRequest(index, request_type::read));
+    return &mshr;
 }
 
-void Cache::process() {
+void Cache::process_request() {
     auto& r = request;  // alias
 
-    if (line_requests.empty()) {
-        const auto [is_hit, way] = lookup(r.addr);
-        if (is_hit) {
-            auto& r = request;  // alias
-
-            uint32_t set = get_set(r.addr);
-            Line& line = cache_mem[way][set];
+    const auto [is_hit, way] = lookup(r.addr);
+    if (is_hit) {
+        uint32_t set = get_set(r.addr);
+        uint8_t* line = get_line_data(set, way);
 
-            uint32_t offset = get_line_offset(r.addr);
-            if (r.request_type == request_type::read) {
-                r.data = line.read_bytes(offset, r.num_bytes);
+        uint32_t offset = get_line_offset(r.addr);
+        if (!r.is_miss) {
+            policy->on_hit(set, way);
+            if (active_mshrs > 0)
+                stats.hits_under_miss++;
+            if (prefetched[get_index(set, way)]) {
+                prefetched[get_index(set, way)] = 0;
+                r.is_prefetch_hit = true;
+                stats.useful_prefetches++;
             }
-            else {
-                line.write_bytes(r.data, offset, r.num_bytes);
-                line.is_dirty = true;
-            }
-            r.is_completed = true;
         }
-        else {
-            uint32_t set = get_set(request.addr);
-            uint32_t way = fifo_queues[set].front();
-            fifo_queues[set].pop();
-            fifo_queues[set].push(way);
 
-            Line& line = cache_mem[way][set];
+        if (r.request_type == request_type::read) {
+            r.data = load_bytes(line + offset, r.num_bytes);
+        }
+        else {
+            store_bytes(line + offset, r.data, r.num_bytes);
+            tags[get_index(set, way)] |= DIRTY;
+        }
+        r.is_completed = true;
+        return;
+    }
 
-            if (line.is_valid && line.is_dirty) {
-                line_requests.push(
-                    LineRequest(get_line_addr(line.addr), set, way, request_type::write)
-                );
+    Mshr* mshr = find_mshr(get_line_addr(r.addr));
+    if (mshr != nullptr) {
+        // Waiting for the victim write-back is not a merge.
+        if (mshr->addr != get_line_addr(r.addr))
+            return;
+        if (!r.is_miss) {
+            r.is_miss = true;
+            stats.secondary_misses++;
+            if (mshr->is_prefetch) {
+                mshr->is_prefetch = false;
+                stats.late_prefetches++;
             }
-
-            line_requests.push(
-                LineRequest(get_line_addr(request.addr), set, way, request_type::read)
-            );
         }
+        if (r.request_type == request_type::write && !is_blocking) {
+            if (merge_store(*mshr))
+                r.is_completed = true;
+            else
+                stats.mshr_stall_cycles++;
+        }
+        return;
+    }
+
+    mshr = allocate_mshr(r.addr, false);
+    if (mshr == nullptr) {
+        stats.mshr_stall_cycles++;
+        return;
     }
+    r.is_miss = true;
+    stats.misses++;
+
+    if (r.request_type == request_type::write && !is_blocking && merge_store(*mshr))
+        r.is_completed = true;
+}
+
+void Cache::process() {
+    process_request();
     process_line_requests();
+
+    auto& r = request;  // alias
+    if (is_critical_word_first && !r.is_completed && r.request_type == request_type::read
+        && !line_requests.empty() && read_from_fill())
+        r.is_completed = true;
 }
 
 
+// Invalid entries never match because the key has the valid bit set; the
+// dirty bit is masked off before comparing.
 std::pair<bool, uint32_t> Cache::lookup(uint32_t addr) {
-    const auto set = get_set(addr);
-    const auto tag = get_tag(addr);
-    for (uint way = 0; way < cache_mem.size(); ++way) {
-        auto& line = cache_mem[way][set];
-        if (get_tag(line.addr) == tag && line.is_valid) {
+    const uint32_t* set_tags = &tags[get_index(get_set(addr), 0)];
+    const uint32_t key = make_tag_entry(addr, VALID);
+    uint32_t way = 0;
+#ifdef __SSE2__
+    const __m128i key_lanes = _mm_set1_epi32(key);
+    const __m128i mask_lanes = _mm_set1_epi32(~DIRTY);
+    for (; way + 4 <= num_ways; way += 4) {
+        __m128i lanes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(set_tags + way));
+        __m128i equal = _mm_cmpeq_epi32(_mm_and_si128(lanes, mask_lanes), key_lanes);
+        int matches = _mm_movemask_ps(_mm_castsi128_ps(equal));
+        if (matches != 0)
+            return {true, way + __builtin_ctz(matches)};
+    }
+#endif
+    for (; way < num_ways; ++way) {
+        if ((set_tags[way] & ~DIRTY) == key)
             return {true, way};
-        }
     }
     return {false, 0xBAAAAAAD};
 }
 
-void Cache::send_read_request(uint32_t addr, uint32_t num_bytes) {
+void Cache::train_prefetcher() {
+    if (prefetcher == nullptr)
+        return;
+
+    Prefetcher::Access access;
+    access.PC = request.PC;
+    access.addr = request.addr;
+    access.is_miss = !request.is_completed || request.is_miss;
+    access.is_prefetch_hit = request.is_prefetch_hit;
+    prefetch_candidates.clear();
+    prefetcher->on_access(access, prefetch_candidates);
+
+    for (uint32_t addr : prefetch_candidates) {
+        if (prefetch_queue.size() == PREFETCH_QUEUE_SIZE)
+            break;
+        if (std::find(prefetch_queue.begin(), prefetch_queue.end(), addr) == prefetch_queue.end())
+            prefetch_queue.push_back(addr);
+    }
+}
+
+// Starts at most one prefetch a cycle. Prefetches never take the last
+// free MSHR while a demand access is in flight; an idle cache with a
+// single MSHR, blocking or not, may use it.
+void Cache::issue_prefetch() {
+    const bool is_idle = active_mshrs == 0 && request.is_completed;
+    while (!prefetch_queue.empty()) {
+        const uint32_t addr = prefetch_queue.front();
+        if (lookup(addr).first || find_mshr(addr) != nullptr) {
+            prefetch_queue.pop_front();
+            continue;
+        }
+        if ((active_mshrs + 1 >= mshrs.size() && !is_idle) || allocate_mshr(addr, true) == nullptr)
+            return;
+        prefetch_queue.pop_front();
+        stats.prefetches++;
+        return;
+    }
+}
+
+bool Cache::back_invalidate(uint32_t addr, uint32_t num_bytes, uint8_t* data) {
+    bool is_dirty = false;
+    for (uint32_t offset = 0; offset < num_bytes; offset += line_size_in_bytes) {
+        const auto [is_hit, way] = lookup(addr + offset);
+        if (!is_hit)
+            continue;
+        const uint32_t set = get_set(addr + offset);
+        uint32_t& tag = tags[get_index(set, way)];
+        if (tag & DIRTY) {
+            std::memcpy(data + offset, get_line_data(set, way), line_size_in_bytes);
+            is_dirty = true;
+        }
+        tag = 0;
+        prefetched[get_index(set, way)] = 0;
+        stats.back_invalidations++;
+    }
+    return is_dirty;
+}
+
+void Cache::invalidate_clean(uint32_t addr, uint32_t num_bytes) {
+    for (uint32_t offset = 0; offset < num_bytes; offset += line_size_in_bytes) {
+        const auto [is_hit, way] = lookup(addr + offset);
+        if (!is_hit)
+            continue;
+        const uint32_t index = get_index(get_set(addr + offset), way);
+        if (!(tags[index] & DIRTY)) {
+            tags[index] = 0;
+            prefetched[index] = 0;
+            stats.back_invalidations++;
+        }
+    }
+}
+
+void Cache::send_read_request(uint32_t addr, uint32_t num_bytes, uint32_t PC, bool is_training) {
     request.request_type = request_type::read;
     request.is_completed = false;
+    request.is_miss = false;
+    request.is_prefetch_hit = false;
+    stats.accesses++;
     request.num_bytes = num_bytes;
     request.addr = addr;
     request.data = 0xBAAAAAAD;
+    request.PC = PC;
 
     process();
     process_called_this_cycle = true;
+    if (is_training)
+        train_prefetcher();
 }
 
-void Cache::send_write_request(uint32_t value, uint32_t addr, uint32_t num_bytes) {
+void Cache::send_write_request(uint32_t value, uint32_t addr, uint32_t num_bytes, uint32_t PC, bool is_training) {
     request.request_type = request_type::write;
     request.is_completed = false;
+    request.is_miss = false;
+    request.is_prefetch_hit = false;
+    stats.accesses++;
     request.num_bytes = num_bytes;
     request.addr = addr;
     request.data = value;
+    request.PC = PC;
 
     process();
     process_called_this_cycle = true;
+    if (is_training)
+        train_prefetcher();
 }
 
 void Cache::clock() {
-    if (request.is_completed)
+    if (active_mshrs > 0) {
+        stats.miss_cycles++;
+        stats.overlapped_cycles += request.is_completed;
+    }
+    if (prefetcher != nullptr)
+        issue_prefetch();
+
+    // Fills keep going after the request that caused them completed.
+    if (request.is_completed) {
+        process_line_requests();
         return;
+    }
 
     if (!process_called_this_cycle)
         process();
@@ -164,6 +397,54 @@ void Cache::clock() {
     process_called_this_cycle = false;
 }
 
+void Cache::warm_up(const CacheWarmer& warmer) {
+    assert(warmer.get_num_ways() == num_ways);
+    assert(warmer.get_num_sets() == num_sets);
+    assert(warmer.get_line_size() == line_size_in_bytes);
+    assert(warmer.get_policy().get_kind() == policy->get_kind());
+
+    for (uint32_t set = 0; set < num_sets; set++) {
+        for (uint32_t way = 0; way < num_ways; way++) {
+            const auto& warm_line = warmer.get_line(way, set);
+            uint32_t& tag = tags[get_index(set, way)];
+            tag = 0;
+            prefetched[get_index(set, way)] = 0;
+            if (warm_line.is_valid) {
+                tag = make_tag_entry(warm_line.addr, VALID | (warm_line.is_dirty ? DIRTY : 0));
+                uint8_t* line = get_line_data(set, way);
+                for (uint32_t i = 0; i < line_size_in_bytes; i += 4)
+                    store_bytes<4>(line + i, memory.read<4>(warm_line.addr + i));
+            }
+        }
+    }
+    policy = warmer.get_policy().clone();
+}
+
+void Cache::print_stats(const char* name) const {
+    const uint64_t all_misses = stats.misses + stats.secondary_misses;
+    std::cout << std::dec << name << " accesses: " << stats.accesses << ", misses: " << all_misses
+              << ", hit rate: " << (stats.accesses ? 1.0 - double(all_misses) / stats.accesses : 0)
+              << ", writebacks: " << stats.writebacks << ", back-invalidations: " << stats.back_invalidations
+              << ", policy: " << policy->get_name() << std::endl;
+    std::cout << name << " MSHRs: " << (is_blocking ? 0 : mshrs.size())
+              << ", secondary misses: " << stats.secondary_misses
+              << ", hits under miss: " << stats.hits_under_miss
+              << ", MSHR stall cycles: " << stats.mshr_stall_cycles
+              << ", overlapped miss cycles: " << stats.overlapped_cycles << " of " << stats.miss_cycles << std::endl;
+    if (prefetcher == nullptr)
+        return;
+
+    // Late prefetches were used but not in time; demand misses left over
+    // are the ones no prefetch covered.
+    const uint64_t used = stats.useful_prefetches + stats.late_prefetches;
+    std::cout << name << " prefetcher: " << prefetcher->get_name() << ", issued: " << stats.prefetches
+              << ", useful: " << stats.useful_prefetches << ", late: " << stats.late_prefetches
+              << ", unused: " << stats.unused_prefetches
+              << ", accuracy: " << (stats.prefetches ? double(used) / stats.prefetches : 0)
+              << ", coverage: " << (used + stats.misses ? double(used) / (used + stats.misses) : 0)
+              << ", timeliness: " << (used ? double(stats.useful_prefetches) / used : 0) << std::endl;
+}
+
 Cache::RequestResult Cache::get_request_status() {
     if (request.is_completed)
         return RequestResult {true, request.data};
@@ -2,50 +2,99 @@
 #define CACHE_H
 
 #include "memory.h"
+#include "byte_access.h"
 #include "consts.h"
+#include "cache_warmer.h"
+#include "replacement_policy.h"
+#include "line_port.h"
+#include "prefetcher.h"
 
+#include <array>
+#include <deque>
 #include <queue>
+#include <memory>
+#include <vector>
 #include <numeric>
 #include <iostream>
 
 
 
-class Cache {
+class Cache : public LineHolder {
 public:
     struct RequestResult {
         bool is_ready = false;
         uint32_t data = 0xBAAAAAAD;
     };
-    Cache(PerfsimMemory& memory, uint32_t num_ways, uint32_t num_sets, uint32_t line_size_in_bytes);
+    struct Stats {
+        uint64_t accesses = 0;
+        uint64_t misses = 0;
+        // Dirty lines written to the next level.
+        uint64_t writebacks = 0;
+        // Lines dropped because the inclusive level below evicted them.
+        uint64_t back_invalidations = 0;
+        // Misses to a line that already had a fill in flight.
+        uint64_t secondary_misses = 0;
+        uint64_t hits_under_miss = 0;
+        // Cycles a request waited for a free MSHR or merge slot.
+        uint64_t mshr_stall_cycles = 0;
+        // Cycles with a fill in flight, and those of them the pipeline
+        // was not waiting on this cache.
+        uint64_t miss_cycles = 0;
+        uint64_t overlapped_cycles = 0;
+        // Prefetch fills started, and of those: lines a demand access hit,
+        // lines a demand access was still waiting for, and lines evicted
+        // unused.
+        uint64_t prefetches = 0;
+        uint64_t useful_prefetches = 0;
+        uint64_t late_prefetches = 0;
+        uint64_t unused_prefetches = 0;
+    };
+    // Lines move to and from next_level; memory is only read to warm up.
+    Cache(const Memory& memory, LinePort& next_level, uint32_t num_ways, uint32_t num_sets, uint32_t line_size_in_bytes,
+          uint32_t policy = ReplacementPolicy::FIFO, bool is_critical_word_first = false, uint32_t num_mshrs = 0,
+          uint32_t prefetcher = Prefetcher::NONE, uint32_t prefetch_degree = 1);
     void clock();
     bool is_busy() { return !request.is_completed; }
-    void send_read_request(uint32_t addr, uint32_t num_bytes);
-    void send_write_request(uint32_t value, uint32_t addr, uint32_t num_bytes);
+    // The PC and address of the access train the prefetcher. Accesses split
+    // into pieces train it on the first piece only.
+    void send_read_request(uint32_t addr, uint32_t num_bytes, uint32_t PC, bool is_training = true);
+    void send_write_request(uint32_t value, uint32_t addr, uint32_t num_bytes, uint32_t PC, bool is_training = true);
     RequestResult get_request_status();
+    void warm_up(const CacheWarmer& warmer);
+    bool back_invalidate(uint32_t addr, uint32_t num_bytes, uint8_t* data) override;
+    void invalidate_clean(uint32_t addr, uint32_t num_bytes) override;
+    Stats get_stats() const { return stats; }
+    void print_stats(const char* name) const;
 private:
-    struct Line {
-        std::vector<uint8_t> data;
-        uint32_t addr = 0xBAAAAAAD;
-        bool is_valid = false;
-        bool is_dirty = false;
-
-
-        Line(uint32_t size_in_bytes) :
-            data(size_in_bytes)
-        { }
-
-        uint32_t read_bytes(uint32_t offset, uint32_t num_bytes);
-        void write_bytes(uint32_t value, uint32_t offset, uint32_t num_bytes);
-    };
-
-    PerfsimMemory& memory;
-    
+    // Set-major structure of arrays: the tags of one set are contiguous and
+    // compared together in lookup(), line data lives in a single slab.
+    // A tag entry is the line number shifted left by FLAG_BITS with the
+    // valid and dirty flags below it; lines are at least four bytes, so
+    // the line number always fits.
+    static const uint32_t VALID = 1;
+    static const uint32_t DIRTY = 2;
+    static const uint32_t FLAG_BITS = 2;
+
+    const Memory& memory;
+    LinePort& next_level;
+
+    uint32_t num_ways;
     uint32_t num_sets;
     uint32_t line_size_in_bytes;
 
+    std::vector<uint32_t> tags;
+    std::vector<uint8_t> data;
+    std::unique_ptr<ReplacementPolicy> policy;
+    bool is_critical_word_first;
+    Stats stats;
 
-    std::vector<std::queue<uint32_t>> fifo_queues;
-    std::vector<std::vector<Line>> cache_mem;
+    // Candidates wait in a short queue until an MSHR is free. Prefetched
+    // lines are flagged until their first demand hit.
+    static const size_t PREFETCH_QUEUE_SIZE = 8;
+    std::unique_ptr<Prefetcher> prefetcher;
+    std::vector<uint32_t> prefetch_candidates;
+    std::deque<uint32_t> prefetch_queue;
+    std::vector<uint8_t> prefetched;
 
     struct Request {
         bool is_completed = true;
@@ -53,21 +102,59 @@ private:
         uint32_t addr = 0xBAAAAAAD;
         uint32_t data = 0xBAAAAAAD;
         uint32_t num_bytes = 0xBAAAAAAD;
+        uint32_t PC = 0xBAAAAAAD;
+        bool is_prefetch_hit = false;
+        // Set on the first lookup that missed, so the lookup after the
+        // fill counts neither as a hit nor as a policy update.
+        bool is_miss = false;
     };
 
-    struct LineRequest {
-        request_type::Request request_type = request_type::read;
-        bool awaiting_memory_request = false;
+    // Miss status holding register: one line being fetched into a reserved
+    // way, after the write-back of the victim if it has to go down.
+    // Stores that miss are merged into it and applied when the line lands,
+    // so they do not hold up the pipeline.
+    static const uint32_t MAX_MERGED_STORES = 8;
+
+    struct MergedStore {
+        uint32_t offset = 0;
+        uint32_t num_bytes = 0;
+        uint32_t value = 0;
+    };
+
+    struct Mshr {
+        bool is_valid = false;
+        bool is_writing_back = false;
+        bool is_victim_dirty = false;
+        // Cleared when a demand access starts waiting for the line.
+        bool is_prefetch = false;
         uint32_t addr = 0xBAAAAAAD;
+        uint32_t victim_addr = 0xBAAAAAAD;
         uint32_t set = 0xBAAAAAAD;
         uint32_t way = 0xBAAAAAAD;
-        uint32_t bytes_processed = 0;
+        // Fills start at the beat holding the missing word when
+        // critical-word-first is on.
+        uint32_t first_offset = 0;
+        uint32_t num_stores = 0;
+        std::array<MergedStore, MAX_MERGED_STORES> stores;
+    };
 
-        LineRequest(uint32_t addr, uint32_t set, uint32_t way, request_type::Request request_type)
-            : request_type(request_type), addr(addr), set(set), way(way)
+    // A line moved to or from memory as one burst on behalf of an MSHR.
+    struct LineRequest {
+        request_type::Request request_type = request_type::read;
+        bool is_sent = false;
+        uint32_t mshr = 0;
+
+        LineRequest(uint32_t mshr, request_type::Request request_type)
+            : request_type(request_type), mshr(mshr)
         { }
     };
 
+    // With no MSHRs configured the cache blocks: one miss at a time and
+    // the request waits for its line.
+    bool is_blocking;
+    std::vector<Mshr> mshrs;
+    uint32_t active_mshrs = 0;
+
     Request request;
 
     std::queue<LineRequest> line_requests;
@@ -76,12 +163,25 @@ private:
     bool process_called_this_cycle = false;
 
     void process_line_requests();
+    void process_request();
+    bool read_from_fill();
+    Mshr* find_mshr(uint32_t line_addr);
+    bool is_reserved(uint32_t set, uint32_t way) const;
+    Mshr* allocate_mshr(uint32_t addr, bool is_prefetch);
+    bool merge_store(Mshr& mshr);
+    void train_prefetcher();
+    void issue_prefetch();
 
     uint get_set(uint32_t addr) const { return (addr / line_size_in_bytes) & (num_sets - 1); }
     uint32_t get_tag(uint32_t addr) const { return (addr / line_size_in_bytes); }
     uint32_t get_line_addr(uint32_t addr) const { return addr - get_line_offset(addr); }
     uint32_t get_line_offset(uint32_t addr) const { return addr % this->line_size_in_bytes; }
 
+    size_t get_index(uint32_t set, uint32_t way) const { return size_t(set) * num_ways + way; }
+    uint8_t* get_line_data(uint32_t set, uint32_t way) { return &data[get_index(set, way) * line_size_in_bytes]; }
+    uint32_t make_tag_entry(uint32_t addr, uint32_t flags) const { return (get_tag(addr) << FLAG_BITS) | flags; }
+    uint32_t get_entry_addr(uint32_t entry) const { return (entry >> FLAG_BITS) * line_size_in_bytes; }
+
     std::pair<bool, uint32_t> lookup(uint32_t addr);
 
 public:
@@ -0,0 +1,17 @@
+#ifndef CACHE_MODEL_H
+#define CACHE_MODEL_H
+
+#include <cstdint>
+
+// Functional consumer of a cache access stream, fed by FuncSim.
+class CacheModel {
+public:
+    virtual ~CacheModel() = default;
+
+    virtual void access(uint32_t addr, bool is_write) = 0;
+    // n more reads of the line accessed last.
+    virtual void repeat(uint32_t n) = 0;
+    virtual uint32_t get_line_size() const = 0;
+};
+
+#endif
@@ -0,0 +1,152 @@
+#include "cache_warmer.h"
+
+#include <string>
+
+CacheWarmer::CacheWarmer(uint32_t num_ways, uint32_t num_sets, uint32_t line_size_in_bytes, uint32_t policy,
+                         uint32_t inclusion)
+    : num_ways(num_ways)
+    , num_sets(num_sets)
+    , line_size_in_bytes(line_size_in_bytes)
+    , inclusion(inclusion)
+    , policy(ReplacementPolicy::create(policy, num_sets, num_ways))
+    , lines(num_ways, std::vector<Line>(num_sets))
+    {}
+
+void CacheWarmer::set_next_level(CacheWarmer& level) {
+    next_level = &level;
+    level.upper_levels.push_back(this);
+}
+
+std::pair<bool, uint32_t> CacheWarmer::lookup(uint32_t addr) const {
+    const uint32_t set = get_set(addr);
+    const uint32_t line_addr = get_line_addr(addr);
+    for (uint32_t way = 0; way < num_ways; ++way) {
+        const Line& line = lines[way][set];
+        if (line.is_valid && line.addr == line_addr)
+            return {true, way};
+    }
+    return {false, 0xBAAAAAAD};
+}
+
+void CacheWarmer::access(uint32_t addr, bool is_write) {
+    const auto [is_hit, way] = lookup(addr);
+    if (is_hit) {
+        const uint32_t set = get_set(addr);
+        lines[way][set].is_dirty |= is_write;
+        policy->on_hit(set, way);
+        hits++;
+        return;
+    }
+    misses++;
+    allocate(addr, is_write, true);
+}
+
+// Same victim choice as Cache::process and UnifiedCache::allocate on a
+// miss, and the same write-back of the victim before the fill.
+void CacheWarmer::allocate(uint32_t addr, bool is_dirty, bool is_fill_needed) {
+    const uint32_t set = get_set(addr);
+    uint32_t way = 0;
+    while (way < num_ways && lines[way][set].is_valid)
+        way++;
+    if (way == num_ways)
+        way = policy->get_victim(set);
+    policy->on_fill(set, way);
+
+    Line& line = lines[way][set];
+    if (line.is_valid) {
+        line.is_valid = false;
+        bool is_victim_dirty = line.is_dirty;
+        if (inclusion == Inclusion::INCLUSIVE && invalidate_upper_levels(line.addr))
+            is_victim_dirty = true;
+        if (next_level != nullptr && (is_victim_dirty || next_level->is_exclusive()))
+            next_level->write_line(line.addr, line_size_in_bytes, is_victim_dirty);
+    }
+    if (is_fill_needed && next_level != nullptr)
+        next_level->read_line(addr);
+
+    line.addr = get_line_addr(addr);
+    line.is_valid = true;
+    line.is_dirty = is_dirty;
+}
+
+// An exclusive level passes missing lines up without keeping them and
+// gives up the clean lines it is read.
+void CacheWarmer::read_line(uint32_t addr) {
+    const auto [is_hit, way] = lookup(addr);
+    if (is_hit) {
+        const uint32_t set = get_set(addr);
+        policy->on_hit(set, way);
+        hits++;
+        if (is_exclusive() && !lines[way][set].is_dirty)
+            lines[way][set].is_valid = false;
+        return;
+    }
+    misses++;
+    if (!is_exclusive())
+        allocate(addr, false, true);
+    else if (next_level != nullptr)
+        next_level->read_line(addr);
+}
+
+void CacheWarmer::write_line(uint32_t addr, uint32_t num_bytes, bool is_dirty) {
+    const auto [is_hit, way] = lookup(addr);
+    if (is_hit) {
+        const uint32_t set = get_set(addr);
+        lines[way][set].is_dirty |= is_dirty;
+        policy->on_hit(set, way);
+        return;
+    }
+    allocate(addr, is_dirty, num_bytes < line_size_in_bytes);
+}
+
+// Mirrors UnifiedCache::back_invalidate and Cache::back_invalidate.
+bool CacheWarmer::back_invalidate(uint32_t addr, uint32_t num_bytes) {
+    bool is_dirty = false;
+    for (uint32_t offset = 0; offset < num_bytes; offset += line_size_in_bytes) {
+        const auto [is_hit, way] = lookup(addr + offset);
+        const bool is_upper_dirty = invalidate_upper_levels(addr + offset);
+        if (!is_hit) {
+            is_dirty |= is_upper_dirty;
+            continue;
+        }
+        Line& line = lines[way][get_set(addr + offset)];
+        is_dirty |= is_upper_dirty || line.is_dirty;
+        line.is_valid = false;
+    }
+    return is_dirty;
+}
+
+bool CacheWarmer::invalidate_upper_levels(uint32_t addr) {
+    bool is_dirty = false;
+    for (auto* level : upper_levels)
+        is_dirty |= level->back_invalidate(addr, line_size_in_bytes);
+    return is_dirty;
+}
+
+void CacheWarmer::print_stats(const char* name) const {
+    std::cout << std::dec << name << " warm-up accesses: " << hits + misses
+              << ", misses: " << misses << ", policy: " << policy->get_name() << std::endl;
+}
+
+HierarchyWarmer::HierarchyWarmer(const Config& config)
+    : icache(config.cache_way, config.cache_set, config.cache_line, config.icache_policy)
+    , dcache(config.cache_way, config.cache_set, config.cache_line, config.dcache_policy)
+{
+    for (uint32_t number = 2; number <= config.cache_levels; number++) {
+        const auto level = config.get_level(number);
+        levels.push_back(std::make_unique<CacheWarmer>(level.way, level.set, level.line, level.policy, level.inclusion));
+    }
+    if (!levels.empty()) {
+        icache.set_next_level(*levels.front());
+        dcache.set_next_level(*levels.front());
+    }
+    for (size_t i = 1; i < levels.size(); i++)
+        levels[i - 1]->set_next_level(*levels[i]);
+}
+
+void HierarchyWarmer::print_stats() const {
+    icache.print_stats("icache");
+    dcache.print_stats("dcache");
+    for (size_t i = 0; i < levels.size(); i++)
+        levels[i]->print_stats(("L" + std::to_string(i + 2)).c_str());
+}
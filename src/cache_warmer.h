@@ -0,0 +1,92 @@
+#ifndef CACHE_WARMER_H
+#define CACHE_WARMER_H
+
+#include <memory>
+#include <vector>
+#include <utility>
+#include <iostream>
+
+#include "consts.h"
+#include "config.h"
+#include "cache_model.h"
+#include "replacement_policy.h"
+#include "line_port.h"
+
+// Functional tag-only model of Cache and UnifiedCache. It is fed the access
+// stream during functional fast-forward and its state is later copied into
+// the detailed cache, so detailed simulation does not start with cold caches.
+// A warmer with a next level sends it the misses and write-backs the
+// detailed hierarchy would, following the inclusion of each level.
+class CacheWarmer : public CacheModel {
+public:
+    struct Line {
+        uint32_t addr = 0xBAAAAAAD;
+        bool is_valid = false;
+        bool is_dirty = false;
+    };
+
+private:
+    uint32_t num_ways;
+    uint32_t num_sets;
+    uint32_t line_size_in_bytes;
+    uint32_t inclusion;
+
+    std::unique_ptr<ReplacementPolicy> policy;
+    std::vector<std::vector<Line>> lines;
+
+    CacheWarmer* next_level = nullptr;
+    std::vector<CacheWarmer*> upper_levels;
+
+    // Demand accesses here, line reads from above for lower levels.
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+
+    uint32_t get_set(uint32_t addr) const { return (addr / line_size_in_bytes) & (num_sets - 1); }
+    uint32_t get_line_addr(uint32_t addr) const { return addr - addr % line_size_in_bytes; }
+
+    std::pair<bool, uint32_t> lookup(uint32_t addr) const;
+    void allocate(uint32_t addr, bool is_dirty, bool is_fill_needed);
+    void read_line(uint32_t addr);
+    void write_line(uint32_t addr, uint32_t num_bytes, bool is_dirty);
+    bool back_invalidate(uint32_t addr, uint32_t num_bytes);
+    bool invalidate_upper_levels(uint32_t addr);
+
+public:
+    CacheWarmer(uint32_t num_ways, uint32_t num_sets, uint32_t line_size_in_bytes, uint32_t policy = ReplacementPolicy::FIFO,
+                uint32_t inclusion = Inclusion::NINE);
+
+    void set_next_level(CacheWarmer& level);
+
+    void access(uint32_t addr, bool is_write) override;
+    void repeat(uint32_t n) override { hits += n; }
+
+    uint32_t get_num_ways() const { return num_ways; }
+    uint32_t get_num_sets() const { return num_sets; }
+    uint32_t get_line_size() const override { return line_size_in_bytes; }
+    bool is_exclusive() const { return inclusion == Inclusion::EXCLUSIVE; }
+    const Line& get_line(uint32_t way, uint32_t set) const { return lines[way][set]; }
+    const ReplacementPolicy& get_policy() const { return *policy; }
+    uint64_t get_hits() const { return hits; }
+    uint64_t get_misses() const { return misses; }
+
+    void print_stats(const char* name) const;
+};
+
+// Warmers for every cache a Config describes, linked the way MMU links the
+// detailed caches. FuncSim feeds icache and dcache.
+class HierarchyWarmer {
+public:
+    CacheWarmer icache;
+    CacheWarmer dcache;
+    // L2 first.
+    std::vector<std::unique_ptr<CacheWarmer>> levels;
+
+    explicit HierarchyWarmer(const Config& config);
+    // The levels point at each other.
+    HierarchyWarmer(const HierarchyWarmer&) = delete;
+    HierarchyWarmer& operator=(const HierarchyWarmer&) = delete;
+
+    void print_stats() const;
+};
+
+#endif
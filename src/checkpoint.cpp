@@ -0,0 +1,157 @@
+#include "checkpoint.h"
+#include "elf_manager.h"
+
+#include <algorithm>
+#include <cstring>
+#include <err.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char MAGIC[8] = {'P', 'S', 'I', 'M', 'C', 'K', 'P', 'T'};
+
+// Header, then the index of every stored page, then the pages themselves
+// starting at the next page boundary.
+uint64_t Checkpoint::pages_offset(uint32_t num_pages) {
+    uint64_t index_end = sizeof(Header) + uint64_t(num_pages) * sizeof(uint32_t);
+    return (index_end + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+}
+
+bool Checkpoint::is_checkpoint(const char* file_name) {
+    int fd = open(file_name, O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+    char magic[sizeof(MAGIC)] = {};
+    bool result = read(fd, magic, sizeof(magic)) == sizeof(magic) &&
+                  memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+    close(fd);
+    return result;
+}
+
+// A private writable mapping: pages are used in place and nothing is
+// read from disk until a simulator touches it. Memory copies a page
+// before its first write anyway, since the mapping is shared.
+static std::shared_ptr<uint8_t> map_file(const char* file_name, size_t& file_size) {
+    int fd = open(file_name, O_RDONLY, 0);
+    if (fd < 0)
+        err(EXIT_FAILURE, "Can't open %s", file_name);
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        err(EXIT_FAILURE, "Can't stat %s", file_name);
+    file_size = st.st_size;
+    if (file_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    void* address = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED)
+        err(EXIT_FAILURE, "Can't map %s", file_name);
+    close(fd);
+    return std::shared_ptr<uint8_t>(static_cast<uint8_t*>(address), [file_size](uint8_t* file) {
+        munmap(file, file_size);
+    });
+}
+
+Checkpoint Checkpoint::load(const char* file_name) {
+    size_t file_size = 0;
+    std::shared_ptr<uint8_t> mapping = map_file(file_name, file_size);
+    if (file_size < sizeof(Header))
+        errx(EXIT_FAILURE, "checkpoint file is truncated");
+    const uint8_t* file = mapping.get();
+
+    Header header;
+    memcpy(&header, file, sizeof(header));
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION)
+        errx(EXIT_FAILURE, "input file is not a checkpoint of this version");
+    uint64_t offset = pages_offset(header.num_pages);
+    if (file_size < offset + uint64_t(header.num_pages) * PAGE_SIZE)
+        errx(EXIT_FAILURE, "checkpoint file is truncated");
+
+    Checkpoint checkpoint;
+    checkpoint.is_restored = true;
+    checkpoint.PC = header.PC;
+    checkpoint.instructions = header.instructions;
+    std::copy(std::begin(header.registers), std::end(header.registers), checkpoint.registers.begin());
+
+    const uint8_t* index = file + sizeof(Header);
+    for (uint32_t i = 0; i < header.num_pages; i++) {
+        uint32_t page;
+        memcpy(&page, index + i * sizeof(uint32_t), sizeof(page));
+        auto* contents = reinterpret_cast<Memory::Page*>(mapping.get() + offset + uint64_t(i) * PAGE_SIZE);
+        checkpoint.pages.emplace(page, std::shared_ptr<Memory::Page>(mapping, contents));
+    }
+    return checkpoint;
+}
+
+// Pages the file bytes of a segment cover whole are used in place from a
+// mapping of the file, as in load; only the partial pages at either end of
+// a segment are copied. .bss and everything else stay unallocated and read
+// as zero.
+Checkpoint Checkpoint::load_program(const char* file_name) {
+    if (is_checkpoint(file_name))
+        return load(file_name);
+
+    ElfManager elfManager(file_name);
+    size_t file_size = 0;
+    std::shared_ptr<uint8_t> mapping = map_file(file_name, file_size);
+    Checkpoint program;
+    program.PC = elfManager.getPC();
+    for (const auto& segment : elfManager.getSegments()) {
+        for (uint32_t done = 0; done < segment.file_size;) {
+            uint32_t addr = segment.vaddr + done;
+            uint32_t offset = addr % PAGE_SIZE;
+            uint32_t size = std::min(PAGE_SIZE - offset, segment.file_size - done);
+            auto& page = program.pages[addr / PAGE_SIZE];
+            if (size == PAGE_SIZE) {
+                auto* contents = reinterpret_cast<Memory::Page*>(mapping.get() + segment.file_offset + done);
+                page = std::shared_ptr<Memory::Page>(mapping, contents);
+            }
+            else {
+                // A page shared with another segment may be in the mapping.
+                page = (page == nullptr) ? std::make_shared<Memory::Page>() : std::make_shared<Memory::Page>(*page);
+                memcpy(page->data() + offset, segment.bytes + done, size);
+            }
+            done += size;
+        }
+    }
+    return program;
+}
+
+void Checkpoint::save(const char* file_name) const {
+    std::vector<std::pair<uint32_t, const Memory::Page*>> stored;
+    for (const auto& page : pages)
+        if (std::any_of(page.second->begin(), page.second->end(), [](uint8_t byte) { return byte != 0; }))
+            stored.emplace_back(page.first, page.second.get());
+
+    Header header = {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.PC = PC;
+    header.instructions = instructions;
+    std::copy(registers.begin(), registers.end(), header.registers);
+    header.num_pages = stored.size();
+
+    std::vector<uint8_t> head(pages_offset(header.num_pages), 0);
+    memcpy(head.data(), &header, sizeof(header));
+    for (size_t i = 0; i < stored.size(); i++)
+        memcpy(head.data() + sizeof(header) + i * sizeof(uint32_t), &stored[i].first, sizeof(uint32_t));
+
+    int fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        err(EXIT_FAILURE, "Can't open checkpoint file");
+    auto write_all = [fd](const uint8_t* buffer, size_t size) {
+        while (size > 0) {
+            ssize_t written = write(fd, buffer, size);
+            if (written < 0)
+                err(EXIT_FAILURE, "Can't write checkpoint file");
+            buffer += written;
+            size -= written;
+        }
+    };
+    write_all(head.data(), head.size());
+    for (const auto& page : stored)
+        write_all(page.second->data(), PAGE_SIZE);
+    close(fd);
+}
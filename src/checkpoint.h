@@ -0,0 +1,47 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <array>
+
+#include "register.h"
+#include "memory.h"
+#include "consts.h"
+
+// Architectural state at a given instruction count: PC, register table and
+// the non-zero pages of memory. Pages are stored page-aligned in the file so
+// a restore maps them instead of reading.
+class Checkpoint {
+public:
+    using Registers = std::array<uint32_t, Register::MAX_NUMBER>;
+
+    uint32_t PC = NO_VAL32;
+    uint64_t instructions = 0;
+    Registers registers = {};
+    Memory::Pages pages;
+    // False for a program freshly loaded from ELF: simulators then set up
+    // the initial registers themselves.
+    bool is_restored = false;
+
+    static bool is_checkpoint(const char* file_name);
+    static Checkpoint load(const char* file_name);
+    // Loads either a checkpoint or an ELF file.
+    static Checkpoint load_program(const char* file_name);
+    void save(const char* file_name) const;
+
+private:
+    static const uint32_t PAGE_SIZE = Memory::PAGE_SIZE;
+    static const uint32_t VERSION = 2;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t PC;
+        uint64_t instructions;
+        uint32_t registers[Register::MAX_NUMBER];
+        uint32_t num_pages;
+    };
+
+    static uint64_t pages_offset(uint32_t num_pages);
+};
+
+#endif
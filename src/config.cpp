@@ -0,0 +1,189 @@
+#include "config.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <err.h>
+
+namespace {
+
+// Fields with a names table take one of those names instead of a number.
+struct Field {
+    const char* name;
+    uint32_t Config::* value;
+    const char* const* names = nullptr;
+    uint32_t num_names = 0;
+};
+
+const Field fields[] = {
+    { "CACHE_WAY",           &Config::cache_way },
+    { "CACHE_SET",           &Config::cache_set },
+    { "CACHE_LINE",          &Config::cache_line },
+    { "MEM_LATENCY",         &Config::mem_latency },
+    { "BEAT_LATENCY",        &Config::beat_latency },
+    { "BUS_WIDTH",           &Config::bus_width },
+    { "CRITICAL_WORD_FIRST", &Config::critical_word_first },
+    { "MSHRS",               &Config::mshrs },
+    { "STORE_BUFFER",        &Config::store_buffer },
+    { "ICACHE_POLICY",       &Config::icache_policy, ReplacementPolicy::names, ReplacementPolicy::MAX },
+    { "DCACHE_POLICY",       &Config::dcache_policy, ReplacementPolicy::names, ReplacementPolicy::MAX },
+    { "ICACHE_PREFETCHER",   &Config::icache_prefetcher, Prefetcher::names, Prefetcher::MAX },
+    { "DCACHE_PREFETCHER",   &Config::dcache_prefetcher, Prefetcher::names, Prefetcher::MAX },
+    { "PREFETCH_DEGREE",     &Config::prefetch_degree },
+    { "BRANCH_PREDICTOR",    &Config::branch_predictor, DirectionPredictor::names, DirectionPredictor::MAX },
+    { "BTB_ENTRIES",         &Config::btb_entries },
+    { "PREDICTOR_ENTRIES",   &Config::predictor_entries },
+    { "HISTORY_LENGTH",      &Config::history_length },
+    { "RAS_DEPTH",           &Config::ras_depth },
+    { "BRANCH_RESOLUTION",   &Config::branch_resolution, HazardUnit::stage_names, HazardUnit::MAX },
+    { "CACHE_LEVELS",        &Config::cache_levels },
+    { "L2_WAY",              &Config::l2_way },
+    { "L2_SET",              &Config::l2_set },
+    { "L2_LINE",             &Config::l2_line },
+    { "L2_LATENCY",          &Config::l2_latency },
+    { "L2_POLICY",           &Config::l2_policy, ReplacementPolicy::names, ReplacementPolicy::MAX },
+    { "L2_INCLUSION",        &Config::l2_inclusion, Inclusion::names, Inclusion::MAX },
+    { "L3_WAY",              &Config::l3_way },
+    { "L3_SET",              &Config::l3_set },
+    { "L3_LINE",             &Config::l3_line },
+    { "L3_LATENCY",          &Config::l3_latency },
+    { "L3_POLICY",           &Config::l3_policy, ReplacementPolicy::names, ReplacementPolicy::MAX },
+    { "L3_INCLUSION",        &Config::l3_inclusion, Inclusion::names, Inclusion::MAX },
+};
+
+std::string to_string(const Field& field, uint32_t value) {
+    if (field.names != nullptr && value < field.num_names)
+        return field.names[value];
+    return std::to_string(value);
+}
+
+std::string trim(const std::string& str) {
+    size_t begin = str.find_first_not_of(" \t\r");
+    if (begin == std::string::npos)
+        return "";
+    size_t end = str.find_last_not_of(" \t\r");
+    return str.substr(begin, end - begin + 1);
+}
+
+bool is_power_of_two(uint32_t x) { return x != 0 && (x & (x - 1)) == 0; }
+
+}
+
+void Config::set(const std::string& key, const std::string& value) {
+    for (const auto& field : fields) {
+        if (key != field.name)
+            continue;
+        if (field.names != nullptr) {
+            for (uint32_t i = 0; i < field.num_names; i++) {
+                if (value == field.names[i]) {
+                    this->*field.value = i;
+                    return;
+                }
+            }
+            errx(EXIT_FAILURE, "Bad value for %s: %s", key.c_str(), value.c_str());
+        }
+        size_t pos = 0;
+        unsigned long number = 0;
+        try {
+            number = std::stoul(value, &pos, 0);
+        } catch (const std::exception&) {
+            pos = 0;
+        }
+        if (pos == 0 || pos != value.size() || number > UINT32_MAX)
+            errx(EXIT_FAILURE, "Bad value for %s: %s", key.c_str(), value.c_str());
+        this->*field.value = static_cast<uint32_t>(number);
+        return;
+    }
+    errx(EXIT_FAILURE, "Unknown config key: %s", key.c_str());
+}
+
+void Config::set(const std::string& assignment) {
+    size_t pos = assignment.find('=');
+    if (pos == std::string::npos)
+        errx(EXIT_FAILURE, "Expected KEY=VALUE: %s", assignment.c_str());
+    set(trim(assignment.substr(0, pos)), trim(assignment.substr(pos + 1)));
+}
+
+void Config::load(const char* file_name) {
+    std::ifstream in(file_name);
+    if (!in)
+        err(EXIT_FAILURE, "Can't open config file");
+    std::string line;
+    while (std::getline(in, line)) {
+        line = trim(line.substr(0, line.find('#')));
+        if (!line.empty())
+            set(line);
+    }
+}
+
+void Config::validate() const {
+    if (cache_way == 0)
+        errx(EXIT_FAILURE, "CACHE_WAY must be positive");
+    if (!is_power_of_two(cache_set))
+        errx(EXIT_FAILURE, "CACHE_SET must be a power of two");
+    if (!is_power_of_two(cache_line) || cache_line < 4)
+        errx(EXIT_FAILURE, "CACHE_LINE must be a power of two of at least 4 bytes");
+    if (mem_latency == 0)
+        errx(EXIT_FAILURE, "MEM_LATENCY must be positive");
+    if (beat_latency == 0)
+        errx(EXIT_FAILURE, "BEAT_LATENCY must be positive");
+    if (!is_power_of_two(bus_width) || bus_width > cache_line)
+        errx(EXIT_FAILURE, "BUS_WIDTH must be a power of two no wider than CACHE_LINE");
+    if (critical_word_first > 1)
+        errx(EXIT_FAILURE, "CRITICAL_WORD_FIRST must be 0 or 1");
+    if ((icache_policy == ReplacementPolicy::PLRU || dcache_policy == ReplacementPolicy::PLRU) && !is_power_of_two(cache_way))
+        errx(EXIT_FAILURE, "PLRU replacement needs a power-of-two CACHE_WAY");
+    if (prefetch_degree == 0)
+        errx(EXIT_FAILURE, "PREFETCH_DEGREE must be positive");
+    if (!is_power_of_two(btb_entries))
+        errx(EXIT_FAILURE, "BTB_ENTRIES must be a power of two");
+    if (!is_power_of_two(predictor_entries))
+        errx(EXIT_FAILURE, "PREDICTOR_ENTRIES must be a power of two");
+    if (history_length == 0 || history_length > 64)
+        errx(EXIT_FAILURE, "HISTORY_LENGTH must be 1 to 64");
+    if (cache_levels < 1 || cache_levels > 3)
+        errx(EXIT_FAILURE, "CACHE_LEVELS must be 1, 2 or 3");
+
+    uint32_t upper_line = cache_line;
+    for (uint32_t number = 2; number <= cache_levels; number++) {
+        const Level level = get_level(number);
+        const std::string prefix = "L" + std::to_string(number) + "_";
+        if (level.way == 0)
+            errx(EXIT_FAILURE, "%sWAY must be positive", prefix.c_str());
+        if (!is_power_of_two(level.set))
+            errx(EXIT_FAILURE, "%sSET must be a power of two", prefix.c_str());
+        if (!is_power_of_two(level.line) || level.line < upper_line)
+            errx(EXIT_FAILURE, "%sLINE must be a power of two no smaller than the line above", prefix.c_str());
+        if (level.inclusion == Inclusion::EXCLUSIVE && level.line != upper_line)
+            errx(EXIT_FAILURE, "An exclusive level needs the line size of the level above, %sLINE", prefix.c_str());
+        if (level.latency == 0)
+            errx(EXIT_FAILURE, "%sLATENCY must be positive", prefix.c_str());
+        if (level.policy == ReplacementPolicy::PLRU && !is_power_of_two(level.way))
+            errx(EXIT_FAILURE, "PLRU replacement needs a power-of-two %sWAY", prefix.c_str());
+        upper_line = level.line;
+    }
+}
+
+Config::Level Config::get_level(uint32_t number) const {
+    if (number == 2)
+        return Level{ l2_way, l2_set, l2_line, l2_latency, l2_policy, l2_inclusion };
+    return Level{ l3_way, l3_set, l3_line, l3_latency, l3_policy, l3_inclusion };
+}
+
+std::string Config::diff(const Config& base) const {
+    std::ostringstream out;
+    for (const auto& field : fields) {
+        if (this->*field.value == base.*field.value)
+            continue;
+        if (out.tellp() > 0)
+            out << ' ';
+        out << field.name << '=' << to_string(field, this->*field.value);
+    }
+    return out.str();
+}
+
+void Config::print() const {
+    for (const auto& field : fields)
+        std::cout << std::dec << field.name << ": " << to_string(field, this->*field.value) << std::endl;
+}
@@ -0,0 +1,88 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <string>
+
+#include "consts.h"
+#include "replacement_policy.h"
+#include "line_port.h"
+#include "prefetcher.h"
+#include "branch_predictor.h"
+#include "hazard_unit.h"
+
+// Microarchitecture parameters chosen at run time. Defaults come from
+// consts.h; a config file and KEY=VALUE arguments override them in order.
+struct Config {
+    uint32_t cache_way = CACHE_WAY;
+    uint32_t cache_set = CACHE_SET;
+    uint32_t cache_line = CACHE_LINE;
+    // Cycles to the first beat of a line transfer, then per further beat.
+    uint32_t mem_latency = MEM_LATENCY;
+    uint32_t beat_latency = BEAT_LATENCY;
+    // Bytes per beat between the caches and memory.
+    uint32_t bus_width = BUS_WIDTH;
+    uint32_t critical_word_first = 1;
+    // Outstanding misses per cache, 0 makes the caches blocking.
+    uint32_t mshrs = MSHRS;
+    // Stores waiting for the dcache, 0 makes stores wait in the memory stage.
+    uint32_t store_buffer = STORE_BUFFER;
+    uint32_t icache_policy = ReplacementPolicy::FIFO;
+    uint32_t dcache_policy = ReplacementPolicy::FIFO;
+    uint32_t icache_prefetcher = Prefetcher::NONE;
+    uint32_t dcache_prefetcher = Prefetcher::NONE;
+    // Lines fetched ahead per prefetch trigger.
+    uint32_t prefetch_degree = PREFETCH_DEGREE;
+    // NONE fetches PC + 4 after every instruction.
+    uint32_t branch_predictor = DirectionPredictor::NONE;
+    uint32_t btb_entries = BTB_ENTRIES;
+    // Counters per table of the direction predictor.
+    uint32_t predictor_entries = PREDICTOR_ENTRIES;
+    // Global history bits, the longest TAGE history.
+    uint32_t history_length = HISTORY_LENGTH;
+    // Return address stack entries, 0 predicts returns with the BTB.
+    uint32_t ras_depth = RAS_DEPTH;
+    // Latest stage to redirect fetch: DECODE resolves jal there and
+    // other jumps and branches in EXECUTE.
+    uint32_t branch_resolution = HazardUnit::MEMORY;
+    // 1 is the L1 caches alone, 2 adds a unified L2 and 3 an L3 below it.
+    uint32_t cache_levels = CACHE_LEVELS;
+    uint32_t l2_way = L2_WAY;
+    uint32_t l2_set = L2_SET;
+    uint32_t l2_line = L2_LINE;
+    // Cycles from a hit to the first beat towards the level above.
+    uint32_t l2_latency = L2_LATENCY;
+    uint32_t l2_policy = ReplacementPolicy::LRU;
+    uint32_t l2_inclusion = Inclusion::NINE;
+    uint32_t l3_way = L3_WAY;
+    uint32_t l3_set = L3_SET;
+    uint32_t l3_line = L3_LINE;
+    uint32_t l3_latency = L3_LATENCY;
+    uint32_t l3_policy = ReplacementPolicy::LRU;
+    uint32_t l3_inclusion = Inclusion::INCLUSIVE;
+
+    // Parameters of the unified level 2 or 3.
+    struct Level {
+        uint32_t way;
+        uint32_t set;
+        uint32_t line;
+        uint32_t latency;
+        uint32_t policy;
+        uint32_t inclusion;
+    };
+    Level get_level(uint32_t number) const;
+
+    // Exits with an error on unknown keys or malformed values.
+    void set(const std::string& key, const std::string& value);
+    void set(const std::string& assignment);
+    // One KEY = VALUE per line, '#' starts a comment.
+    void load(const char* file_name);
+    void validate() const;
+
+    // KEY=VALUE pairs that differ from base, space separated.
+    std::string diff(const Config& base) const;
+    void print() const;
+
+    static bool is_assignment(const std::string& arg) { return arg.find('=') != std::string::npos; }
+};
+
+#endif
@@ -5,7 +5,30 @@ const size_t CACHE_WAY   = 4;
 const size_t CACHE_SET   = 64;
 const size_t CACHE_LINE  = 16;
 
-const size_t MEM_LATENCY = 2;
+const size_t MEM_LATENCY  = 2;
+const size_t BEAT_LATENCY = 1;
+const size_t BUS_WIDTH    = 4;
+
+const size_t MSHRS       = 0;
+
+const size_t STORE_BUFFER = 0;
+
+const size_t PREFETCH_DEGREE = 2;
+
+const size_t BTB_ENTRIES       = 256;
+const size_t PREDICTOR_ENTRIES = 1024;
+const size_t HISTORY_LENGTH    = 16;
+const size_t RAS_DEPTH         = 8;
+
+const size_t CACHE_LEVELS = 1;
+const size_t L2_WAY       = 8;
+const size_t L2_SET       = 256;
+const size_t L2_LINE      = 16;
+const size_t L2_LATENCY   = 6;
+const size_t L3_WAY       = 16;
+const size_t L3_SET       = 1024;
+const size_t L3_LINE      = 32;
+const size_t L3_LATENCY   = 16;
 
 const bool IS_DUMP_RF    = 0;
 const bool IS_DUMP_MEM   = 0;
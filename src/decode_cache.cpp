@@ -0,0 +1,73 @@
+#include "decode_cache.h"
+
+DecodeCache::Page& DecodeCache::get_page(uint32_t page_num) {
+    if (page_num == last_page_num)
+        return *last_page;
+
+    auto& page = pages[page_num];
+    if (page == nullptr)
+        page = std::make_unique<Page>(PAGE_ENTRIES);
+
+    last_page_num = page_num;
+    last_page = page.get();
+    return *page;
+}
+
+const DecodeCache::Entry& DecodeCache::lookup(uint32_t PC, Memory& memory) {
+    Entry& entry = get_page(get_page_num(PC))[get_page_index(PC)];
+
+    if (entry.instr.has_value() && entry.PC == PC) {
+        hits++;
+        return entry;
+    }
+
+    misses++;
+    entry.PC = PC;
+    entry.raw_bytes = memory.read<4>(PC);
+    entry.instr.emplace(entry.raw_bytes, PC);
+    return entry;
+}
+
+// Drops the entry held in the slot of word_addr if its four instruction
+// bytes overlap the stored range. Pages never get allocated here.
+void DecodeCache::invalidate_slot(uint32_t word_addr, uint32_t addr, size_t num_bytes) {
+    auto it = pages.find(get_page_num(word_addr));
+    if (it == pages.end())
+        return;
+
+    Entry& entry = (*it->second)[get_page_index(word_addr)];
+    if (!entry.instr.has_value())
+        return;
+
+    uint64_t store_begin = addr;
+    uint64_t store_end = store_begin + num_bytes;
+    uint64_t instr_begin = entry.PC;
+    uint64_t instr_end = instr_begin + 4;
+    if (instr_end <= store_begin || store_end <= instr_begin)
+        return;
+
+    entry.instr.reset();
+    entry.PC = NO_VAL32;
+    invalidations++;
+}
+
+// An entry starting up to three bytes before addr still covers it, so the
+// slot of the word holding addr - 3 is checked as well.
+void DecodeCache::invalidate(uint32_t addr, size_t num_bytes) {
+    if (pages.empty() || num_bytes == 0)
+        return;
+
+    uint32_t first_word = (addr - 3) & ~3u;
+    uint32_t last_word = (addr + uint32_t(num_bytes) - 1) & ~3u;
+    for (uint32_t word = first_word; ; word += 4) {
+        invalidate_slot(word, addr, num_bytes);
+        if (word == last_word)
+            break;
+    }
+}
+
+void DecodeCache::print_stats() const {
+    std::cout << std::dec << "Decode cache hits: " << hits << std::endl;
+    std::cout << "Decode cache misses: " << misses << std::endl;
+    std::cout << "Decode cache invalidations: " << invalidations << std::endl;
+}
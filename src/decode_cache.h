@@ -0,0 +1,52 @@
+#ifndef DECODE_CACHE_H
+#define DECODE_CACHE_H
+
+#include <vector>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+
+#include "instruction.h"
+#include "memory.h"
+
+// Keeps decoded instructions per PC so hot code is decoded once.
+// Entries are grouped by page and tagged with their full PC, so a
+// misaligned PC never hits the entry of the word it falls into. A store
+// drops only the entries whose instruction bytes it overlaps.
+class DecodeCache {
+public:
+    struct Entry {
+        uint32_t PC = NO_VAL32;
+        uint32_t raw_bytes = NO_VAL32;
+        std::optional<Instruction> instr;
+    };
+
+private:
+    static constexpr uint32_t PAGE_BITS = 12;
+    static constexpr uint32_t PAGE_ENTRIES = (1u << PAGE_BITS) / 4;
+
+    using Page = std::vector<Entry>;
+
+    std::unordered_map<uint32_t, std::unique_ptr<Page>> pages;
+
+    uint32_t last_page_num = NO_VAL32;
+    Page* last_page = nullptr;
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t invalidations = 0;
+
+    static uint32_t get_page_num(uint32_t addr) { return addr >> PAGE_BITS; }
+    static uint32_t get_page_index(uint32_t addr) { return (addr & ((1u << PAGE_BITS) - 1)) >> 2; }
+
+    Page& get_page(uint32_t page_num);
+    void invalidate_slot(uint32_t word_addr, uint32_t addr, size_t num_bytes);
+
+public:
+    const Entry& lookup(uint32_t PC, Memory& memory);
+    void invalidate(uint32_t addr, size_t num_bytes);
+
+    void print_stats() const;
+};
+
+#endif
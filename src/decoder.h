@@ -20,11 +20,11 @@ enum class Opcode : uint8_t {
 class Decoder {
 private:
 
-    uint8_t rs1;
-    uint8_t rs2;
-    uint8_t rd;
+    uint8_t rs1 = 0;
+    uint8_t rs2 = 0;
+    uint8_t rd = 0;
 
-    uint32_t imm;
+    uint32_t imm = 0;
 public:
     Decoder();
     Register get_rs1() { 
@@ -1,5 +1,7 @@
 #include "elf_manager.h"
 #include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 int check_input(const char* file_name) {
     if (elf_version(EV_CURRENT) == EV_NONE)
@@ -48,20 +50,38 @@ void ElfManager::read_phdrs(Elf* elf, size_t phdr_num) {
     }
 }
 
-size_t read_words_num(std::vector<GElf_Phdr>& phdrs) {
-    auto best = *std::max_element(phdrs.begin(), phdrs.end(), [](GElf_Phdr a, GElf_Phdr b){ return a.p_vaddr + a.p_memsz < b.p_vaddr + b.p_memsz; });
-    return best.p_vaddr + best.p_memsz;
+void ElfManager::map_file(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        err(EXIT_FAILURE, "Can't stat input file");
+    file_size = st.st_size;
+    if (file_size == 0)
+        return;
+    void* mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED)
+        err(EXIT_FAILURE, "Can't map input file");
+    file = static_cast<uint8_t*>(mapping);
 }
 
-void ElfManager::read_words(int fd) {
-    words.resize(read_words_num(phdrs) / sizeof(uint8_t));
-    for (size_t i = 0; i < phdrs.size(); i++) {
-        std::vector<uint8_t> current(phdrs[i].p_memsz);
-        lseek(fd, phdrs[i].p_offset, SEEK_SET);
-        if (read(fd, &(current[0]), phdrs[i].p_filesz) < 0)
-            errx(EXIT_FAILURE, "read failed: %s", elf_errmsg(-1));
-        words.insert(words.begin() + phdrs[i].p_paddr / sizeof(uint8_t), current.begin(), current.end());
+// Segments point into the mapping, the loader copies what it needs.
+void ElfManager::read_segments() {
+    for (const auto& phdr : phdrs) {
+        if (phdr.p_type != PT_LOAD || phdr.p_memsz == 0)
+            continue;
+        if (phdr.p_filesz > phdr.p_memsz || phdr.p_offset + phdr.p_filesz > file_size ||
+            phdr.p_vaddr + phdr.p_memsz > (1ull << 32))
+            errx(EXIT_FAILURE, "input file has a malformed segment");
+        segments.push_back({static_cast<uint32_t>(phdr.p_vaddr), static_cast<uint32_t>(phdr.p_filesz),
+                            static_cast<uint32_t>(phdr.p_memsz), static_cast<uint32_t>(phdr.p_offset),
+                            file + phdr.p_offset});
     }
+    if (segments.empty())
+        errx(EXIT_FAILURE, "input file has no loadable segments");
+}
+
+ElfManager::~ElfManager() {
+    if (file != nullptr)
+        munmap(file, file_size);
 }
 
 ElfManager::ElfManager(const char* file_name) {
@@ -70,7 +90,8 @@ ElfManager::ElfManager(const char* file_name) {
     PC = read_pc(elf);
     auto phdr_num = read_phdrnum(elf);
     read_phdrs(elf, phdr_num);
-    read_words(fd);
+    map_file(fd);
+    read_segments();
     elf_end(elf);
     close(fd);
 }
@@ -7,18 +7,34 @@
 
 class ElfManager {
 public:
+    // Loadable segment backed by the mapped file; the tail past file_size
+    // up to mem_size (.bss) has no file bytes and reads as zero.
+    struct Segment {
+        uint32_t vaddr;
+        uint32_t file_size;
+        uint32_t mem_size;
+        uint32_t file_offset;
+        const uint8_t* bytes;
+    };
+
     ElfManager() = delete;
     ElfManager(const char* file_name);
-    ~ElfManager(){}
+    ~ElfManager();
+    ElfManager(const ElfManager&) = delete;
+    ElfManager& operator=(const ElfManager&) = delete;
 
-    std::vector<uint8_t>& getWords() { return words; }
+    const std::vector<Segment>& getSegments() const { return segments; }
     uint32_t getPC() { return PC; }
 
 private:
     uint32_t PC;
-    std::vector<uint8_t> words;
     std::vector<GElf_Phdr> phdrs;
+    std::vector<Segment> segments;
+
+    uint8_t* file = nullptr;
+    size_t file_size = 0;
 
-    void read_words(int fd);
+    void map_file(int fd);
+    void read_segments();
     void read_phdrs(Elf* elf, size_t phdr_num);
 };
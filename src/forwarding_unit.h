@@ -16,9 +16,12 @@ private:
     Record bypass_mem;
     Record bypass_exe;
 
+    static bool is_zero(const Record& data) { return data.reg == static_cast<uint32_t>(Register::zero()); }
+
 public:
-    void set_bypass_mem (Record data) { bypass_mem = data; }
-    void set_bypass_exe (Record data) { bypass_exe = data; }
+    // Writes to $zero are dropped, so they are never forwarded either.
+    void set_bypass_mem (Record data) { bypass_mem = is_zero(data) ? Record() : data; }
+    void set_bypass_exe (Record data) { bypass_exe = is_zero(data) ? Record() : data; }
 
     uint32_t read_sources (Instruction& instr);
     void flush();
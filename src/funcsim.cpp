@@ -1,31 +1,87 @@
 #include "funcsim.h"
 
-FuncSim::FuncSim(std::vector<uint8_t>& data, uint32_t PC):
-    memory(data),
+FuncSim::FuncSim(const Memory::Pages& image, uint32_t PC, Engine engine):
+    memory(image),
     rf(),
-    PC(PC)
+    threaded_engine(memory, engine == Engine::JIT),
+    PC(PC),
+    engine(engine)
 {
     rf.set_stack_pointer(memory.get_stack_pointer());
     rf.validate(Register::Names::s0);
     rf.validate(Register::Names::ra);
 }
 
+void FuncSim::set_warmers(CacheModel* icache, CacheModel* dcache) {
+    icache_warmer = icache;
+    dcache_warmer = dcache;
+    threaded_engine.set_warmers(icache, dcache);
+}
+
+void FuncSim::set_branch_warmer(BranchPredictor* predictor) {
+    branch_warmer = predictor;
+    threaded_engine.set_branch_warmer(predictor);
+}
+
 void FuncSim::step() {
-    uint32_t raw_bytes = memory.read_word(PC);
-    Instruction instr(raw_bytes, PC);
+    if (icache_warmer != nullptr)
+        icache_warmer->access(PC, false);
+
+    const auto& entry = decode_cache.lookup(PC, memory);
+    uint32_t raw_bytes = entry.raw_bytes;
+    Instruction instr(*entry.instr);
     rf.read_sources(instr);
     instr.execute();
+    if (instr.is_store())
+        decode_cache.invalidate(instr.get_memory_addr(), instr.get_memory_size());
+    if (dcache_warmer != nullptr && (instr.is_load() || instr.is_store()))
+        dcache_warmer->access(instr.get_memory_addr(), instr.is_store());
     memory.load_store(instr);
     rf.writeback(instr);
+    if (branch_warmer != nullptr && (instr.is_jump() || instr.is_branch()))
+        branch_warmer->train(instr);
     //memory.dump();
 
-    std::cout << "0x" << std::hex << PC << ": " << instr.get_disasm() << " " << "(0x" << std::hex << raw_bytes << ")" << std::endl;
+    if (trace_writer != nullptr) {
+        trace::Record record;
+        record.PC = PC;
+        record.raw_bytes = raw_bytes;
+        record.new_PC = instr.get_new_PC();
+        record.is_memory = instr.is_load() || instr.is_store();
+        record.memory_addr = instr.get_memory_addr();
+        record.has_rd_value = !instr.is_load() && instr.get_rd() != Register::zero();
+        record.rd_value = instr.get_rd_v();
+        trace_writer->record(record);
+    }
+
+    if (is_trace)
+        std::cout << "0x" << std::hex << PC << ": " << instr.get_disasm() << " " << "(0x" << std::hex << raw_bytes << ")" << std::endl;
     rf.dump();
 
     PC = instr.get_new_PC();
 }
 
-void FuncSim::run(uint32_t n) {
-    for (uint32_t i = 0; i < n; ++i)
+void FuncSim::run_threaded(uint64_t n) {
+    auto registers = rf.get_values();
+    PC = threaded_engine.run(registers, PC, n);
+    rf.set_values(registers);
+    rf.dump();
+}
+
+void FuncSim::run(uint64_t n) {
+    if ((engine == Engine::THREADED || engine == Engine::JIT) && trace_writer == nullptr) {
+        run_threaded(n);
+        return;
+    }
+
+    for (uint64_t i = 0; i < n; ++i)
         step();
 }
+
+void FuncSim::print_stats() const {
+    std::cout << std::endl;
+    if (engine == Engine::THREADED || engine == Engine::JIT)
+        threaded_engine.print_stats();
+    else
+        decode_cache.print_stats();
+}
@@ -5,18 +5,57 @@
 
 #include "rf.h"
 #include "memory.h"
+#include "decode_cache.h"
+#include "threaded_engine.h"
+#include "cache_model.h"
+#include "trace.h"
 #include "elf.h"
 #include "consts.h"
 
 class FuncSim {
+    public:
+        enum class Engine {
+            INTERPRETER,
+            THREADED,
+            JIT
+        };
+
     private:
         FuncsimMemory memory;
         RF rf;
+        DecodeCache decode_cache;
+        ThreadedEngine threaded_engine;
         uint32_t PC = NO_VAL32;
+        Engine engine = Engine::INTERPRETER;
+
+        CacheModel* icache_warmer = nullptr;
+        CacheModel* dcache_warmer = nullptr;
+        BranchPredictor* branch_warmer = nullptr;
+
+        bool is_trace = true;
+        trace::Writer* trace_writer = nullptr;
+
+        void run_threaded(uint64_t n);
     public:
-        FuncSim(std::vector<uint8_t>& data, uint32_t PC);
+        FuncSim(const Memory::Pages& image, uint32_t PC, Engine engine = Engine::INTERPRETER);
         void step();
-        void run(uint32_t n);
+        void run(uint64_t n);
+        void print_stats() const;
+
+        // Feeds fetches and memory accesses to functional cache models.
+        void set_warmers(CacheModel* icache, CacheModel* dcache);
+        // Trains a branch predictor on every jump and branch.
+        void set_branch_warmer(BranchPredictor* predictor);
+        void set_trace(bool value) { is_trace = value; }
+        // Records every instruction; runs on the interpreter while set.
+        void set_trace_writer(trace::Writer* writer) { trace_writer = writer; }
+        // Collects a basic block profile; threaded engines only.
+        void set_profile(ThreadedEngine::BlockProfile* profile) { threaded_engine.set_profile(profile); }
+
+        uint32_t get_PC() const { return PC; }
+        std::array<uint32_t, Register::MAX_NUMBER> get_registers() const { return rf.get_values(); }
+        void set_registers(const std::array<uint32_t, Register::MAX_NUMBER>& values) { rf.set_values(values); }
+        Memory::Pages get_memory_pages() const { return memory.get_pages(); }
 };
 
 #endif
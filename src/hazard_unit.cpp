@@ -1,11 +1,13 @@
 #include "hazard_unit.h"
 
+const char* const HazardUnit::stage_names[MAX] = { "DECODE", "EXECUTE", "MEMORY" };
+
 void HazardUnit::update_stats() {
     is_any_stall = (static_cast<int>(is_branch_mispredict) + static_cast<int>(is_fetch_stall) + static_cast<int>(is_memory_stall) + static_cast<int>(is_data_stall)) > 1;
     if (is_any_stall) {
         latency_total++;
         if (is_branch_mispredict) 
-            mispredict_penalty += 2;
+            mispredict_penalty += mispredict_cycles - 1;
     } else {
         if (is_fetch_stall || is_memory_stall) {
             latency_memory++;
@@ -13,7 +15,7 @@ void HazardUnit::update_stats() {
         if (is_data_stall)
             latency_data_dependency++;
         if (is_branch_mispredict)
-            mispredict_penalty += 3;
+            mispredict_penalty += mispredict_cycles;
     }
 }
 
@@ -45,7 +47,8 @@ void HazardUnit::reset() {
 uint32_t HazardUnit::handle_mispredict_fetch(uint32_t PC, bool& is_request) {
     if (memory_to_all_flush) {
         is_request = false;
-        std::cout << "FLUSH, ";
+        if (is_trace)
+            std::cout << "FLUSH, ";
         return memory_to_fetch_target;
     } else
         return PC;
@@ -85,8 +88,9 @@ void HazardUnit::set_stall_memory() {
     is_memory_stall = true;
 }
 
-void HazardUnit::set_mispredict(uint32_t PC) {
+void HazardUnit::set_mispredict(uint32_t PC, Stage stage) {
     memory_to_all_flush = true;
     memory_to_fetch_target = PC;
     is_branch_mispredict = true;
+    mispredict_cycles = stage + 1;
 }
@@ -5,6 +5,25 @@
 #include "consts.h"
 
 class HazardUnit {
+public:
+    // Stages that can resolve a jump or branch. A redirect from one
+    // flushes the wrong-path instructions in the stages before it.
+    enum Stage : uint32_t {
+        DECODE,
+        EXECUTE,
+        MEMORY,
+        MAX
+    };
+    static const char* const stage_names[MAX];
+
+    struct Stats {
+        uint32_t cycles = 0;
+        uint32_t instructions = 0;
+        uint32_t data_dependency = 0;
+        uint32_t memory = 0;
+        uint32_t mispredict = 0;
+    };
+
 private:
     uint32_t mispredict_penalty = 0;
     uint32_t latency_data_dependency = 0;
@@ -14,11 +33,14 @@ private:
     bool is_pipe_not_empty = true;
 
     bool is_branch_mispredict = false;
+    // Cycles lost to the last redirect, one per flushed stage.
+    uint32_t mispredict_cycles = 0;
     bool is_fetch_stall = false;
     bool is_data_stall = false;
     bool is_memory_stall = false;
     bool is_any_stall = false;
 
+    // Set by the resolving stage; the stages run after it flush.
     uint32_t memory_to_fetch_target = NO_VAL32;
     bool memory_to_all_flush = false;
 
@@ -30,10 +52,16 @@ private:
     uint32_t execute_stage_regs = 32;
     uint32_t memory_stage_regs = 32;
 
+    bool is_trace = true;
+
 public:
     void update_stats();
     void print_stats(const uint32_t cycles, const uint32_t instructions) const;
+    Stats get_stats(const uint32_t cycles, const uint32_t instructions) const {
+        return {cycles, instructions, latency_data_dependency, latency_memory, mispredict_penalty};
+    }
     void reset();
+    void set_trace(bool value) { is_trace = value; }
 
     bool check_stall_FD() { return FD_stage_reg_stall; }
     void set_pipe_not_empty() { is_pipe_not_empty = true; }
@@ -49,7 +77,7 @@ public:
 
     uint32_t handle_mispredict_fetch(uint32_t PC, bool& is_request);
     bool is_mispredict() { return memory_to_all_flush; }
-    void set_mispredict(uint32_t PC);
+    void set_mispredict(uint32_t PC, Stage stage = MEMORY);
     
     uint32_t get_real_PC() { return memory_to_fetch_target; }
 
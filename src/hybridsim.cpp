@@ -0,0 +1,26 @@
+#include "hybridsim.h"
+
+HybridSim::HybridSim(const Memory::Pages& image, uint32_t PC, const Config& config):
+    fsim(image, PC, FuncSim::Engine::THREADED),
+    warmer(config),
+    predictor(config.branch_predictor, config.btb_entries, config.predictor_entries, config.history_length, config.ras_depth),
+    config(config)
+{
+    fsim.set_warmers(&warmer.icache, &warmer.dcache);
+    if (predictor.is_enabled())
+        fsim.set_branch_warmer(&predictor);
+}
+
+void HybridSim::run(uint64_t fast_forward, uint32_t n) {
+    fsim.run(fast_forward);
+
+    std::cout << std::dec << "Fast-forwarded " << fast_forward << " instructions to PC 0x"
+              << std::hex << fsim.get_PC() << std::dec << std::endl;
+    warmer.print_stats();
+
+    PerfSim psim(fsim.get_memory_pages(), fsim.get_PC(), config);
+    psim.set_registers(fsim.get_registers());
+    psim.warm_up(warmer);
+    psim.warm_up(predictor);
+    psim.run(n);
+}
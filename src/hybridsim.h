@@ -0,0 +1,27 @@
+#ifndef HYBRIDSIM_H
+#define HYBRIDSIM_H
+
+
+#include "funcsim.h"
+#include "perfsim.h"
+#include "cache_warmer.h"
+#include "consts.h"
+#include "config.h"
+
+// Runs a functional fast-forward with cache and branch predictor warm-up,
+// then hands the architectural state to PerfSim for a detailed measurement
+// window.
+class HybridSim {
+private:
+    FuncSim fsim;
+    HierarchyWarmer warmer;
+    BranchPredictor predictor;
+    Config config;
+
+public:
+    HybridSim(const Memory::Pages& image, uint32_t PC, const Config& config = Config());
+    void run(uint64_t fast_forward, uint32_t n);
+    void set_registers(const std::array<uint32_t, Register::MAX_NUMBER>& values) { fsim.set_registers(values); }
+};
+
+#endif
@@ -1,3 +1,4 @@
+#include <array>
 #include <sstream>
 
 #include "instruction.h"
@@ -8,49 +9,49 @@ using Format = Instruction::Format;
 using Type = Instruction::Type;
 
 struct InstSetItem {
-    std::string name;
+    const char* name;
     uint32_t match;
     uint32_t mask;
     Instruction::Executor function;
 };
 
-static const InstSetItem inst_lui = {"lui", 0x37, 0x7f, &Instruction::execute_lui};
-static const InstSetItem inst_auipc = {"auipc", 0x17, 0x7f, &Instruction::execute_auipc};
-static const InstSetItem inst_addi = {"addi", 0x13, 0x707f, &Instruction::execute_addi};
-static const InstSetItem inst_slli = {"slli", 0x1013, 0xfc00707f, &Instruction::execute_slli};
-static const InstSetItem inst_slti = {"slti", 0x2013, 0x707f, &Instruction::execute_slti};
-static const InstSetItem inst_jal = {"jal", 0x6f, 0x7f, &Instruction::execute_jal};
-static const InstSetItem inst_jalr = {"jalr", 0x67, 0x707f, &Instruction::execute_jalr};
-static const InstSetItem inst_beq = {"beq", 0x63, 0x707f, &Instruction::execute_beq};
-static const InstSetItem inst_bne = {"bne", 0x1063, 0x707f, &Instruction::execute_bne};
-static const InstSetItem inst_blt = {"blt", 0x4063, 0x707f, &Instruction::execute_blt};
-static const InstSetItem inst_bge = {"bge", 0x5063, 0x707f, &Instruction::execute_bge};
-static const InstSetItem inst_bltu = {"bltu", 0x6063, 0x707f, &Instruction::execute_bltu};
-static const InstSetItem inst_bgeu = {"bgeu", 0x7063, 0x707f, &Instruction::execute_bgeu};
-static const InstSetItem inst_lb = {"lb", 0x3, 0x707f, &Instruction::execute_lb};
-static const InstSetItem inst_lh = {"lh", 0x1003, 0x707f, &Instruction::execute_lh};
-static const InstSetItem inst_lw = {"lw", 0x2003, 0x707f, &Instruction::execute_lw};
-static const InstSetItem inst_lbu = {"lbu", 0x4003, 0x707f, &Instruction::execute_lbu};
-static const InstSetItem inst_lhu = {"lhu", 0x5003, 0x707f, &Instruction::execute_lhu};
-static const InstSetItem inst_sb = {"sb", 0x23, 0x707f, &Instruction::execute_sb};
-static const InstSetItem inst_sh = {"sh", 0x1023, 0x707f, &Instruction::execute_sh};
-static const InstSetItem inst_sw = {"sw", 0x2023, 0x707f, &Instruction::execute_sw};
-static const InstSetItem inst_sltiu = {"sltiu", 0x3013, 0x707f, &Instruction::execute_sltiu};
-static const InstSetItem inst_xori = {"xori", 0x4013, 0x707f, &Instruction::execute_xori};
-static const InstSetItem inst_ori = {"ori", 0x6013, 0x707f, &Instruction::execute_ori};
-static const InstSetItem inst_andi = {"andi", 0x7013, 0x707f, &Instruction::execute_andi};
-static const InstSetItem inst_srai = {"srai", 0x40005013, 0xfc00707f, &Instruction::execute_srai};
-static const InstSetItem inst_srli = {"srli", 0x5013, 0xfc00707f, &Instruction::execute_srli};
-static const InstSetItem inst_add = {"add", 0x33, 0xfe00707f, &Instruction::execute_add};
-static const InstSetItem inst_sub = {"sub", 0x40000033, 0xfe00707f, &Instruction::execute_sub};
-static const InstSetItem inst_sll = {"sll", 0x1033, 0xfe00707f, &Instruction::execute_sll};
-static const InstSetItem inst_slt = {"slt", 0x2033, 0xfe00707f, &Instruction::execute_slt};
-static const InstSetItem inst_sltu = {"sltu", 0x3033, 0xfe00707f, &Instruction::execute_sltu};
-static const InstSetItem inst_xor = {"xor", 0x4033, 0xfe00707f, &Instruction::execute_xor};
-static const InstSetItem inst_or = {"or", 0x6033, 0xfe00707f, &Instruction::execute_or};
-static const InstSetItem inst_and = {"and", 0x7033, 0xfe00707f, &Instruction::execute_and};
-static const InstSetItem inst_sra = {"sra", 0x40005033, 0xfe00707f, &Instruction::execute_sra};
-static const InstSetItem inst_srl = {"srl", 0x5033, 0xfe00707f, &Instruction::execute_srl};
+static constexpr InstSetItem inst_lui = {"lui", 0x37, 0x7f, &Instruction::execute_lui};
+static constexpr InstSetItem inst_auipc = {"auipc", 0x17, 0x7f, &Instruction::execute_auipc};
+static constexpr InstSetItem inst_addi = {"addi", 0x13, 0x707f, &Instruction::execute_addi};
+static constexpr InstSetItem inst_slli = {"slli", 0x1013, 0xfc00707f, &Instruction::execute_slli};
+static constexpr InstSetItem inst_slti = {"slti", 0x2013, 0x707f, &Instruction::execute_slti};
+static constexpr InstSetItem inst_jal = {"jal", 0x6f, 0x7f, &Instruction::execute_jal};
+static constexpr InstSetItem inst_jalr = {"jalr", 0x67, 0x707f, &Instruction::execute_jalr};
+static constexpr InstSetItem inst_beq = {"beq", 0x63, 0x707f, &Instruction::execute_beq};
+static constexpr InstSetItem inst_bne = {"bne", 0x1063, 0x707f, &Instruction::execute_bne};
+static constexpr InstSetItem inst_blt = {"blt", 0x4063, 0x707f, &Instruction::execute_blt};
+static constexpr InstSetItem inst_bge = {"bge", 0x5063, 0x707f, &Instruction::execute_bge};
+static constexpr InstSetItem inst_bltu = {"bltu", 0x6063, 0x707f, &Instruction::execute_bltu};
+static constexpr InstSetItem inst_bgeu = {"bgeu", 0x7063, 0x707f, &Instruction::execute_bgeu};
+static constexpr InstSetItem inst_lb = {"lb", 0x3, 0x707f, &Instruction::execute_lb};
+static constexpr InstSetItem inst_lh = {"lh", 0x1003, 0x707f, &Instruction::execute_lh};
+static constexpr InstSetItem inst_lw = {"lw", 0x2003, 0x707f, &Instruction::execute_lw};
+static constexpr InstSetItem inst_lbu = {"lbu", 0x4003, 0x707f, &Instruction::execute_lbu};
+static constexpr InstSetItem inst_lhu = {"lhu", 0x5003, 0x707f, &Instruction::execute_lhu};
+static constexpr InstSetItem inst_sb = {"sb", 0x23, 0x707f, &Instruction::execute_sb};
+static constexpr InstSetItem inst_sh = {"sh", 0x1023, 0x707f, &Instruction::execute_sh};
+static constexpr InstSetItem inst_sw = {"sw", 0x2023, 0x707f, &Instruction::execute_sw};
+static constexpr InstSetItem inst_sltiu = {"sltiu", 0x3013, 0x707f, &Instruction::execute_sltiu};
+static constexpr InstSetItem inst_xori = {"xori", 0x4013, 0x707f, &Instruction::execute_xori};
+static constexpr InstSetItem inst_ori = {"ori", 0x6013, 0x707f, &Instruction::execute_ori};
+static constexpr InstSetItem inst_andi = {"andi", 0x7013, 0x707f, &Instruction::execute_andi};
+static constexpr InstSetItem inst_srai = {"srai", 0x40005013, 0xfc00707f, &Instruction::execute_srai};
+static constexpr InstSetItem inst_srli = {"srli", 0x5013, 0xfc00707f, &Instruction::execute_srli};
+static constexpr InstSetItem inst_add = {"add", 0x33, 0xfe00707f, &Instruction::execute_add};
+static constexpr InstSetItem inst_sub = {"sub", 0x40000033, 0xfe00707f, &Instruction::execute_sub};
+static constexpr InstSetItem inst_sll = {"sll", 0x1033, 0xfe00707f, &Instruction::execute_sll};
+static constexpr InstSetItem inst_slt = {"slt", 0x2033, 0xfe00707f, &Instruction::execute_slt};
+static constexpr InstSetItem inst_sltu = {"sltu", 0x3033, 0xfe00707f, &Instruction::execute_sltu};
+static constexpr InstSetItem inst_xor = {"xor", 0x4033, 0xfe00707f, &Instruction::execute_xor};
+static constexpr InstSetItem inst_or = {"or", 0x6033, 0xfe00707f, &Instruction::execute_or};
+static constexpr InstSetItem inst_and = {"and", 0x7033, 0xfe00707f, &Instruction::execute_and};
+static constexpr InstSetItem inst_sra = {"sra", 0x40005033, 0xfe00707f, &Instruction::execute_sra};
+static constexpr InstSetItem inst_srl = {"srl", 0x5033, 0xfe00707f, &Instruction::execute_srl};
 
 struct InstSet {
     InstSetItem generated_entry;
@@ -58,12 +59,12 @@ struct InstSet {
     size_t memory_size;
     Type type;
 
-    bool match(uint32_t raw) const { 
+    constexpr bool match(uint32_t raw) const {
         return (raw & generated_entry.mask) == generated_entry.match;
     }
 };
 
-static const std::vector<InstSet> instSet = {
+static constexpr InstSet instSet[] = {
    { inst_lui,     Format::U,     0,    Type::ARITHM },
    { inst_auipc,   Format::U,     0,    Type::ARITHM },
    { inst_jal,     Format::J,     0,    Type::JUMP },
@@ -104,11 +105,48 @@ static const std::vector<InstSet> instSet = {
 };
 
 
-const InstSet find_entry(uint32_t raw) {
-    for (const auto& x : instSet) {
-        if (x.match(raw))
-            return x;
+// Decode table is indexed by opcode[6:2], funct3 and funct7[5] (bit 30), which
+// is enough to tell every instSet entry apart. The table holds an index into
+// instSet and the full mask/match is checked once on the selected entry.
+namespace decode_table {
+    constexpr uint32_t KEY_MASK = 0x4000707c;
+    constexpr size_t SIZE = 1 << 9;
+    constexpr uint8_t NO_ENTRY = 0xff;
+    constexpr size_t NUM_ENTRIES = sizeof(instSet) / sizeof(instSet[0]);
+    static_assert(NUM_ENTRIES < NO_ENTRY, "Too many instSet entries for decode table");
+
+    constexpr size_t index(uint32_t raw) {
+        return ((raw >> 2) & 0x1f) | (((raw >> 12) & 0x7) << 5) | (((raw >> 30) & 0x1) << 8);
+    }
+
+    constexpr uint32_t key(size_t index) {
+        return ((index & 0x1f) << 2) | (((index >> 5) & 0x7) << 12) | (((index >> 8) & 0x1) << 30) | 0x3;
+    }
+
+    constexpr std::array<uint8_t, SIZE> generate() {
+        std::array<uint8_t, SIZE> table{};
+        for (size_t i = 0; i < SIZE; ++i) {
+            table[i] = NO_ENTRY;
+            uint32_t raw = key(i);
+            for (size_t j = 0; j < NUM_ENTRIES; ++j) {
+                uint32_t mask = instSet[j].generated_entry.mask & (KEY_MASK | 0x3);
+                if ((raw & mask) == (instSet[j].generated_entry.match & mask)) {
+                    table[i] = static_cast<uint8_t>(j);
+                    break;
+                }
+            }
+        }
+        return table;
     }
+
+    static constexpr std::array<uint8_t, SIZE> table = generate();
+}
+
+
+const InstSet& find_entry(uint32_t raw) {
+    uint8_t entry = decode_table::table[decode_table::index(raw)];
+    if (entry != decode_table::NO_ENTRY && instSet[entry].match(raw))
+        return instSet[entry];
     throw std::invalid_argument("No entry found for given instruction");
 }
 
@@ -117,7 +155,9 @@ Instruction::Instruction(uint32_t bytes, uint32_t PC) :
     PC(PC),
     new_PC(PC + 4)
 {
-    InstSet entry = find_entry(bytes);
+    prediction.next_PC = PC + 4;
+
+    const InstSet& entry = find_entry(bytes);
 
     name  = entry.generated_entry.name;
     format = entry.format;
@@ -168,6 +208,7 @@ const std::string Instruction::get_disasm() const {
 Instruction::Instruction(const Instruction& other) :
     PC(other.PC),
     new_PC(other.new_PC),
+    prediction(other.prediction),
     complete(other.complete),
     name(other.name),
     format(other.format),
@@ -24,12 +24,23 @@ public:
 
     using Executor = void (Instruction::*)(void);
 
+    // Where fetch went on to, and the front-end state it predicted with,
+    // restored when the instruction turns out mispredicted.
+    struct Prediction {
+        uint32_t next_PC = NO_VAL32;
+        uint64_t history = 0;
+        uint32_t ras_top = 0;
+        uint32_t ras_size = 0;
+        uint32_t ras_value = 0;
+    };
+
 private:
     const uint32_t PC = NO_VAL32;
     uint32_t new_PC = NO_VAL32;
+    Prediction prediction;
 
     bool complete = false;
-    std::string name = "unknown";
+    const char* name = "unknown";
     Format format = Format::UNKNOWN;
     Type type = Type::UNKNOWN;
 
@@ -61,6 +72,13 @@ public:
     bool is_store () const { return type == Type::STORE; }
     bool is_jump () const { return (type == Type::JUMP); }
     bool is_branch () const { return (type == Type::BRANCH); }
+    bool is_direct_jump () const { return is_jump() && format == Format::J; }
+    // Calls and returns as the calling convention marks them.
+    bool is_call () const { return is_jump() && static_cast<size_t>(rd) == static_cast<size_t>(Register::Names::ra); }
+    bool is_return () const {
+        return is_jump() && format == Format::I && static_cast<size_t>(rd) == static_cast<size_t>(Register::Names::zero)
+            && static_cast<size_t>(rs1) == static_cast<size_t>(Register::Names::ra);
+    }
     
     void set_rs1_v (uint32_t value) { rs1_v = value; }
     void set_rs2_v (uint32_t value) { rs2_v = value; }
@@ -73,6 +91,9 @@ public:
 
     uint32_t get_PC      () const { return PC;     }
     uint32_t get_new_PC  () const { return new_PC; }
+    uint32_t get_predicted_PC() const { return prediction.next_PC; }
+    const Prediction& get_prediction() const { return prediction; }
+    void set_prediction(const Prediction& value) { prediction = value; }
 
     uint32_t get_memory_addr() const { return memory_addr; }
     uint32_t get_memory_size() const { return memory_size; }
@@ -81,6 +102,15 @@ public:
     const std::string get_disasm() const;
 
     void execute();
+    // Takes the outcome recorded in a trace instead of executing. Loads
+    // get rd_v from memory later, as executed ones do.
+    void replay(uint32_t new_PC, uint32_t memory_addr, uint32_t rd_v = NO_VAL32) {
+        this->new_PC = new_PC;
+        this->memory_addr = memory_addr;
+        this->rd_v = rd_v;
+        complete = true;
+    }
+    bool is_complete() const { return complete; }
     void execute_unknown();
     void execute_lui();
     void execute_auipc();
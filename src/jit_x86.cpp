@@ -0,0 +1,337 @@
+#include "jit_x86.h"
+
+#include <cstddef>
+#include <cstring>
+#include <sys/mman.h>
+
+using OpCode = ThreadedEngine::OpCode;
+using Op = ThreadedEngine::Op;
+
+namespace {
+    // x86 register numbers used by the emitter.
+    const uint8_t EAX = 0;
+    const uint8_t ECX = 1;
+    const uint8_t EDX = 2;
+
+    // Condition codes for setcc/jcc.
+    const uint8_t CC_B  = 0x2;
+    const uint8_t CC_AE = 0x3;
+    const uint8_t CC_E  = 0x4;
+    const uint8_t CC_NE = 0x5;
+    const uint8_t CC_L  = 0xc;
+    const uint8_t CC_GE = 0xd;
+
+    const uint8_t OFFSET_REGS     = offsetof(JitContext, regs);
+    const uint8_t OFFSET_BUDGET   = offsetof(JitContext, budget);
+    const uint8_t OFFSET_PC       = offsetof(JitContext, PC);
+
+    static_assert(offsetof(JitContext, is_code_modified) < 128, "JitContext must be addressable with disp8");
+
+    enum LoadKind : uint32_t { LOAD_B, LOAD_H, LOAD_W, LOAD_BU, LOAD_HU };
+
+    uint32_t jit_load(JitContext* context, uint32_t addr, uint32_t kind) {
+        switch (kind) {
+            case LOAD_B:  return static_cast<uint32_t>(static_cast<int8_t>(context->memory->read<1>(addr)));
+            case LOAD_H:  return static_cast<uint32_t>(static_cast<int16_t>(context->memory->read<2>(addr)));
+            case LOAD_BU: return context->memory->read<1>(addr);
+            case LOAD_HU: return context->memory->read<2>(addr);
+            default:      return context->memory->read<4>(addr);
+        }
+    }
+
+    uint32_t jit_store(JitContext* context, uint32_t addr, uint32_t value, uint32_t num_bytes) {
+        context->memory->write(value, addr, num_bytes);
+        const auto& pages = *context->code_pages;
+        const uint32_t page_bits = context->page_bits;
+        if (pages[addr >> page_bits] || pages[(addr + num_bytes - 1) >> page_bits]) {
+            context->is_code_modified = true;
+            return 1;
+        }
+        return 0;
+    }
+}
+
+X86Jit::X86Jit(uint32_t page_bits) {
+    context.page_bits = page_bits;
+#if defined(__x86_64__)
+    void* buffer = mmap(nullptr, CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buffer == MAP_FAILED) {
+        std::cerr << "JIT disabled: cannot map executable memory" << std::endl;
+        return;
+    }
+    code = static_cast<uint8_t*>(buffer);
+    reset();
+#else
+    std::cerr << "JIT disabled: host is not x86-64" << std::endl;
+#endif
+}
+
+X86Jit::~X86Jit() {
+    if (code != nullptr)
+        munmap(code, CODE_SIZE);
+}
+
+void X86Jit::emit32(uint32_t value) {
+    std::memcpy(pos, &value, sizeof(value));
+    pos += sizeof(value);
+}
+
+void X86Jit::emit64(uint64_t value) {
+    std::memcpy(pos, &value, sizeof(value));
+    pos += sizeof(value);
+}
+
+void X86Jit::emit_rel32(const uint8_t* target) {
+    emit32(static_cast<uint32_t>(target - (pos + 4)));
+}
+
+void X86Jit::patch_rel32(uint8_t* at, const uint8_t* target) {
+    uint32_t rel = static_cast<uint32_t>(target - (at + 4));
+    std::memcpy(at, &rel, sizeof(rel));
+}
+
+// mov reg, [r12 + 4 * guest_reg]
+void X86Jit::emit_load_reg(uint8_t x86_reg, uint8_t guest_reg) {
+    emit8(0x41); emit8(0x8b); emit8(0x44 | (x86_reg << 3)); emit8(0x24); emit8(guest_reg * 4);
+}
+
+// mov [r12 + 4 * guest_reg], reg
+void X86Jit::emit_store_reg(uint8_t x86_reg, uint8_t guest_reg) {
+    if (guest_reg == ThreadedEngine::SINK_REGISTER)
+        return;
+    emit8(0x41); emit8(0x89); emit8(0x44 | (x86_reg << 3)); emit8(0x24); emit8(guest_reg * 4);
+}
+
+// mov dword [r12 + 4 * guest_reg], imm32
+void X86Jit::emit_store_imm(uint8_t guest_reg, uint32_t value) {
+    if (guest_reg == ThreadedEngine::SINK_REGISTER)
+        return;
+    emit8(0x41); emit8(0xc7); emit8(0x44); emit8(0x24); emit8(guest_reg * 4); emit32(value);
+}
+
+// Leaves the block for a known PC. The leading jmp falls through to the
+// exit path until the target is translated, then it is patched to chain.
+void X86Jit::emit_exit(uint32_t PC) {
+    emit8(0xe9);
+    uint8_t* link = pos;
+    auto it = chain_entries.find(PC);
+    if (it != chain_entries.end()) {
+        emit_rel32(it->second);
+    } else {
+        emit32(0);
+        pending_links.emplace(PC, link);
+    }
+    emit8(0xc7); emit8(0x43); emit8(OFFSET_PC); emit32(PC);     // mov dword [rbx + PC], imm32
+    emit8(0xe9); emit_rel32(epilogue);                           // jmp epilogue
+}
+
+void X86Jit::emit_epilogue() {
+    epilogue = pos;
+    emit8(0x8b); emit8(0x43); emit8(OFFSET_PC);                  // mov eax, [rbx + PC]
+    emit8(0x5d);                                                 // pop rbp
+    emit8(0x41); emit8(0x5c);                                    // pop r12
+    emit8(0x5b);                                                 // pop rbx
+    emit8(0xc3);                                                 // ret
+}
+
+void X86Jit::reset() {
+    if (code == nullptr)
+        return;
+    pos = code;
+    chain_entries.clear();
+    pending_links.clear();
+    emit_epilogue();
+}
+
+X86Jit::Entry X86Jit::translate(uint32_t PC, const std::vector<Op>& ops, size_t num_instructions) {
+    if (code == nullptr)
+        return nullptr;
+    if (static_cast<size_t>(pos - code) + MAX_BLOCK_CODE > CODE_SIZE)
+        return nullptr;
+
+    uint8_t* entry = pos;
+
+    // Prologue: keep the context in rbx and the register array in r12.
+    emit8(0x53);                                                 // push rbx
+    emit8(0x41); emit8(0x54);                                    // push r12
+    emit8(0x55);                                                 // push rbp
+    emit8(0x48); emit8(0x89); emit8(0xfb);                       // mov rbx, rdi
+    emit8(0x4c); emit8(0x8b); emit8(0x63); emit8(OFFSET_REGS);   // mov r12, [rbx + regs]
+
+    // Chain entry: bail out to the dispatcher if the budget is too small.
+    uint8_t* chain_entry = pos;
+    const uint32_t size = static_cast<uint32_t>(num_instructions);
+    emit8(0x48); emit8(0x8b); emit8(0x43); emit8(OFFSET_BUDGET); // mov rax, [rbx + budget]
+    emit8(0x48); emit8(0x3d); emit32(size);                      // cmp rax, size
+    emit8(0x73); emit8(12);                                      // jae +12
+    emit8(0xc7); emit8(0x43); emit8(OFFSET_PC); emit32(PC);      // mov dword [rbx + PC], block PC
+    emit8(0xe9); emit_rel32(epilogue);                           // jmp epilogue
+    emit8(0x48); emit8(0x2d); emit32(size);                      // sub rax, size
+    emit8(0x48); emit8(0x89); emit8(0x43); emit8(OFFSET_BUDGET); // mov [rbx + budget], rax
+
+    auto emit_alu_rr = [this](const Op& op, uint8_t opcode) {
+        emit_load_reg(EAX, op.rs1);
+        emit_load_reg(ECX, op.rs2);
+        emit8(opcode); emit8(0xc8);                              // op eax, ecx
+        emit_store_reg(EAX, op.rd);
+    };
+    auto emit_alu_ri = [this](const Op& op, uint8_t opcode) {
+        emit_load_reg(EAX, op.rs1);
+        emit8(opcode); emit32(static_cast<uint32_t>(op.imm));    // op eax, imm32
+        emit_store_reg(EAX, op.rd);
+    };
+    auto emit_shift_rr = [this](const Op& op, uint8_t modrm) {
+        emit_load_reg(EAX, op.rs1);
+        emit_load_reg(ECX, op.rs2);
+        emit8(0xd3); emit8(modrm);                               // shift eax, cl
+        emit_store_reg(EAX, op.rd);
+    };
+    auto emit_shift_ri = [this](const Op& op, uint8_t modrm) {
+        emit_load_reg(EAX, op.rs1);
+        emit8(0xc1); emit8(modrm); emit8(op.imm & 0x1f);         // shift eax, imm8
+        emit_store_reg(EAX, op.rd);
+    };
+    auto emit_setcc = [this](const Op& op, uint8_t cc) {
+        emit8(0x0f); emit8(0x90 | cc); emit8(0xc0);              // setcc al
+        emit8(0x0f); emit8(0xb6); emit8(0xc0);                   // movzx eax, al
+        emit_store_reg(EAX, op.rd);
+    };
+    auto emit_branch = [this](const Op& op, uint8_t cc) {
+        emit_load_reg(EAX, op.rs1);
+        emit_load_reg(ECX, op.rs2);
+        emit8(0x39); emit8(0xc8);                                // cmp eax, ecx
+        emit8(0x0f); emit8(0x80 | (cc ^ 1));                     // jncc fall-through
+        uint8_t* skip = pos;
+        emit32(0);
+        emit_exit(op.PC + op.imm);
+        patch_rel32(skip, pos);
+        emit_exit(op.PC + 4);
+    };
+    auto emit_address = [this](const Op& op) {
+        emit_load_reg(EAX, op.rs1);
+        emit8(0x05); emit32(static_cast<uint32_t>(op.imm));      // add eax, imm32
+        emit8(0x89); emit8(0xc6);                                // mov esi, eax
+        emit8(0x48); emit8(0x89); emit8(0xdf);                   // mov rdi, rbx
+    };
+    auto emit_call = [this](const void* function) {
+        emit8(0x48); emit8(0xb8); emit64(reinterpret_cast<uint64_t>(function)); // mov rax, imm64
+        emit8(0xff); emit8(0xd0);                                // call rax
+    };
+    auto emit_load = [&](const Op& op, uint32_t kind) {
+        emit_address(op);
+        emit8(0xba); emit32(kind);                               // mov edx, kind
+        emit_call(reinterpret_cast<const void*>(&jit_load));
+        emit_store_reg(EAX, op.rd);
+    };
+    auto emit_store = [&](const Op& op, uint32_t num_bytes, uint32_t retired) {
+        emit_address(op);
+        emit_load_reg(EDX, op.rs2);
+        emit8(0xb9); emit32(num_bytes);                          // mov ecx, num_bytes
+        emit_call(reinterpret_cast<const void*>(&jit_store));
+        emit8(0x85); emit8(0xc0);                                // test eax, eax
+        emit8(0x74); emit8(20);                                  // jz +20
+        // The store hit translated code: give back the unexecuted budget and leave.
+        emit8(0x48); emit8(0x81); emit8(0x43); emit8(OFFSET_BUDGET); emit32(size - retired); // add qword [rbx + budget], imm32
+        emit8(0xc7); emit8(0x43); emit8(OFFSET_PC); emit32(op.PC + 4);                    // mov dword [rbx + PC], imm32
+        emit8(0xe9); emit_rel32(epilogue);                                                // jmp epilogue
+    };
+
+    bool is_terminated = false;
+    for (size_t i = 0; i < num_instructions; ++i) {
+        const Op& op = ops[i];
+        switch (op.code) {
+            case OpCode::LUI:   emit_store_imm(op.rd, op.imm); break;
+            case OpCode::AUIPC: emit_store_imm(op.rd, op.PC + op.imm); break;
+            case OpCode::JAL:
+                emit_store_imm(op.rd, op.PC + 4);
+                emit_exit(op.PC + op.imm);
+                is_terminated = true;
+                break;
+            case OpCode::JALR:
+                emit_load_reg(EAX, op.rs1);
+                emit8(0x05); emit32(static_cast<uint32_t>(op.imm)); // add eax, imm32
+                emit8(0x25); emit32(~1u);                           // and eax, ~1
+                emit_store_imm(op.rd, op.PC + 4);
+                emit8(0x89); emit8(0x43); emit8(OFFSET_PC);         // mov [rbx + PC], eax
+                emit8(0xe9); emit_rel32(epilogue);                  // jmp epilogue
+                is_terminated = true;
+                break;
+            case OpCode::BEQ:  emit_branch(op, CC_E);  is_terminated = true; break;
+            case OpCode::BNE:  emit_branch(op, CC_NE); is_terminated = true; break;
+            case OpCode::BLT:  emit_branch(op, CC_L);  is_terminated = true; break;
+            case OpCode::BGE:  emit_branch(op, CC_GE); is_terminated = true; break;
+            case OpCode::BLTU: emit_branch(op, CC_B);  is_terminated = true; break;
+            case OpCode::BGEU: emit_branch(op, CC_AE); is_terminated = true; break;
+            case OpCode::LB:  emit_load(op, LOAD_B);  break;
+            case OpCode::LH:  emit_load(op, LOAD_H);  break;
+            case OpCode::LW:  emit_load(op, LOAD_W);  break;
+            case OpCode::LBU: emit_load(op, LOAD_BU); break;
+            case OpCode::LHU: emit_load(op, LOAD_HU); break;
+            case OpCode::SB: emit_store(op, 1, i + 1); break;
+            case OpCode::SH: emit_store(op, 2, i + 1); break;
+            case OpCode::SW: emit_store(op, 4, i + 1); break;
+            case OpCode::ADDI: emit_alu_ri(op, 0x05); break;
+            case OpCode::XORI: emit_alu_ri(op, 0x35); break;
+            case OpCode::ORI:  emit_alu_ri(op, 0x0d); break;
+            case OpCode::ANDI: emit_alu_ri(op, 0x25); break;
+            case OpCode::SLTI:
+                emit_load_reg(EAX, op.rs1);
+                emit8(0x3d); emit32(static_cast<uint32_t>(op.imm)); // cmp eax, imm32
+                emit_setcc(op, CC_L);
+                break;
+            case OpCode::SLTIU:
+                emit_load_reg(EAX, op.rs1);
+                emit8(0x3d); emit32(static_cast<uint32_t>(op.imm)); // cmp eax, imm32
+                emit_setcc(op, CC_B);
+                break;
+            case OpCode::SLLI: emit_shift_ri(op, 0xe0); break;
+            case OpCode::SRLI: emit_shift_ri(op, 0xe8); break;
+            case OpCode::SRAI: emit_shift_ri(op, 0xf8); break;
+            case OpCode::ADD: emit_alu_rr(op, 0x01); break;
+            case OpCode::SUB: emit_alu_rr(op, 0x29); break;
+            case OpCode::XOR: emit_alu_rr(op, 0x31); break;
+            case OpCode::OR:  emit_alu_rr(op, 0x09); break;
+            case OpCode::AND: emit_alu_rr(op, 0x21); break;
+            case OpCode::SLL: emit_shift_rr(op, 0xe0); break;
+            case OpCode::SRL: emit_shift_rr(op, 0xe8); break;
+            case OpCode::SRA: emit_shift_rr(op, 0xf8); break;
+            case OpCode::SLT:
+                emit_load_reg(EAX, op.rs1);
+                emit_load_reg(ECX, op.rs2);
+                emit8(0x39); emit8(0xc8);                           // cmp eax, ecx
+                emit_setcc(op, CC_L);
+                break;
+            case OpCode::SLTU:
+                emit_load_reg(EAX, op.rs1);
+                emit_load_reg(ECX, op.rs2);
+                emit8(0x39); emit8(0xc8);                           // cmp eax, ecx
+                emit_setcc(op, CC_B);
+                break;
+            default:
+                // Unknown op: drop what was emitted and keep interpreting.
+                pos = entry;
+                return nullptr;
+        }
+    }
+
+    if (!is_terminated)
+        emit_exit(ops[num_instructions].PC);
+
+    chain_entries[PC] = chain_entry;
+    auto range = pending_links.equal_range(PC);
+    for (auto it = range.first; it != range.second; ++it) {
+        patch_rel32(it->second, chain_entry);
+        links_patched++;
+    }
+    pending_links.erase(PC);
+
+    blocks_translated++;
+    return reinterpret_cast<Entry>(entry);
+}
+
+void X86Jit::print_stats() const {
+    std::cout << std::dec << "JIT blocks translated: " << blocks_translated << std::endl;
+    std::cout << "JIT links patched: " << links_patched << std::endl;
+    std::cout << "JIT code size: " << (pos - code) << std::endl;
+}
@@ -0,0 +1,76 @@
+#ifndef JIT_X86_H
+#define JIT_X86_H
+
+#include <vector>
+#include <unordered_map>
+
+#include "memory.h"
+#include "consts.h"
+#include "threaded_engine.h"
+
+// State shared between the dispatcher and translated code. Translated
+// blocks keep a pointer to it in rbx, so field offsets must fit in disp8.
+struct JitContext {
+    uint32_t* regs = nullptr;
+    uint64_t budget = 0;
+    Memory* memory = nullptr;
+    const std::vector<bool>* code_pages = nullptr;
+    uint32_t page_bits = 0;
+    uint32_t PC = NO_VAL32;
+    bool is_code_modified = false;
+};
+
+// Translates hot RV32I basic blocks into x86-64 code. Guest registers stay
+// in the engine's register array; loads and stores call back into C++.
+// Direct jumps and branches are chained to the target block once it is
+// translated too, so hot loops never leave native code.
+class X86Jit {
+public:
+    using Entry = uint32_t (*)(JitContext*);
+
+    JitContext context;
+
+private:
+    static const size_t CODE_SIZE = 16 << 20;
+    static const size_t MAX_BLOCK_CODE = 4096;
+
+    uint8_t* code = nullptr;
+    uint8_t* pos = nullptr;
+    uint8_t* epilogue = nullptr;
+
+    // Chain entries skip the prologue and only check the budget.
+    std::unordered_map<uint32_t, uint8_t*> chain_entries;
+    std::unordered_multimap<uint32_t, uint8_t*> pending_links;
+
+    uint64_t blocks_translated = 0;
+    uint64_t links_patched = 0;
+
+    void emit8(uint8_t byte) { *pos++ = byte; }
+    void emit32(uint32_t value);
+    void emit64(uint64_t value);
+    void emit_rel32(const uint8_t* target);
+    void patch_rel32(uint8_t* at, const uint8_t* target);
+
+    void emit_load_reg(uint8_t x86_reg, uint8_t guest_reg);
+    void emit_store_reg(uint8_t x86_reg, uint8_t guest_reg);
+    void emit_store_imm(uint8_t guest_reg, uint32_t value);
+    void emit_exit(uint32_t PC);
+    void emit_epilogue();
+
+public:
+    X86Jit(uint32_t page_bits);
+    ~X86Jit();
+    X86Jit(const X86Jit&) = delete;
+    X86Jit& operator=(const X86Jit&) = delete;
+
+    bool is_available() const { return code != nullptr; }
+
+    // Returns nullptr when the block cannot be translated; the caller keeps
+    // interpreting it.
+    Entry translate(uint32_t PC, const std::vector<ThreadedEngine::Op>& ops, size_t num_instructions);
+    void reset();
+
+    void print_stats() const;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef LINE_PORT_H
+#define LINE_PORT_H
+
+#include <cstdint>
+
+// What a lower cache level guarantees about the lines held above it.
+// INCLUSIVE keeps a copy of every line above and back-invalidates them
+// when it evicts its own, EXCLUSIVE holds only lines evicted from above,
+// NINE (non-inclusive non-exclusive) does neither.
+struct Inclusion {
+    enum Kind : uint32_t {
+        INCLUSIVE,
+        EXCLUSIVE,
+        NINE,
+        MAX
+    };
+    static const char* const names[MAX];
+};
+
+// The side of a memory level that faces the caches above it. It moves one
+// line burst at a time: a client waits until the port is not busy, sends
+// a burst, polls its status and releases the port once it has completed.
+class LinePort {
+public:
+    struct BurstStatus {
+        // Bytes transferred so far, counted from the first beat.
+        uint32_t bytes_done = 0;
+        bool is_completed = true;
+    };
+
+    virtual ~LinePort() = default;
+
+    virtual bool is_busy() const = 0;
+    virtual void release() = 0;
+    virtual uint32_t get_bus_width() const = 0;
+    // Exclusive levels only get the lines the levels above evict, so
+    // those are sent down even when they are clean. Dirty lines stay in
+    // the exclusive level when read; the levels above get clean copies.
+    virtual bool is_exclusive() const = 0;
+
+    // The line buffer must stay valid until the burst completes; the first
+    // offset must be a multiple of the bus width.
+    virtual void send_read_burst(uint32_t addr, uint8_t* line, uint32_t num_bytes, uint32_t first_offset) = 0;
+    // A clean line does not overwrite a copy the level already has.
+    virtual void send_write_burst(uint32_t addr, uint8_t* line, uint32_t num_bytes, bool is_dirty) = 0;
+    virtual BurstStatus get_burst_status() const = 0;
+};
+
+// A cache whose lines a lower inclusive level can take away.
+class LineHolder {
+public:
+    virtual ~LineHolder() = default;
+
+    // Drops every copy of [addr, addr + num_bytes), also from the levels
+    // above. Dirty lines are copied to data at their offset from addr;
+    // returns whether there were any.
+    virtual bool back_invalidate(uint32_t addr, uint32_t num_bytes, uint8_t* data) = 0;
+    // Drops the clean copies of [addr, addr + num_bytes), which a newer
+    // line written back below has made stale. Dirty copies are newer
+    // still and stay.
+    virtual void invalidate_clean(uint32_t addr, uint32_t num_bytes) = 0;
+};
+
+#endif
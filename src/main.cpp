@@ -1,24 +1,194 @@
 #include "elf_manager.h"
 #include "perfsim.h"
 #include "funcsim.h"
+#include "hybridsim.h"
+#include "samplingsim.h"
+#include "simpointsim.h"
+#include "checkpoint.h"
+#include "batch_runner.h"
+#include "config.h"
+#include "stack_distance.h"
+#include "trace.h"
+#include "memory_benchmark.h"
+#include <string>
+#include <vector>
 #include <iostream>
 
 int main(int argc, char** argv) {
+    // KEY=VALUE arguments may appear anywhere and configure the model;
+    // config=FILE loads a config file. The rest are positional.
+    std::vector<char*> args;
+    std::vector<std::string> assignments;
+    for (int i = 0; i < argc; i++) {
+        if (i > 0 && Config::is_assignment(argv[i]))
+            assignments.push_back(argv[i]);
+        else
+            args.push_back(argv[i]);
+    }
+    argc = args.size();
+    argv = args.data();
+
     if (argc < 3) {
-        std::cout << "Required arguments (1):FILE_NAME (2):NUM_CYCLES (3 optional):IS_FUNCTIONAL_SIMULATOR" << std::endl;
+        std::cout << "Required arguments (1):FILE_NAME (ELF or checkpoint) (2):NUM_CYCLES (3 optional):MODE" << std::endl;
+        std::cout << "MODE: 0 - performance (default), 1 - functional interpreter, 2 - functional threaded, 3 - functional jit," << std::endl;
+        std::cout << "      4 - fast-forward then performance, (4):FAST_FORWARD instructions" << std::endl;
+        std::cout << "      5 - sampled performance, (4):PERIOD (5):WARM_UP (6):MEASURE instructions" << std::endl;
+        std::cout << "      6 - SimPoint performance, (4):INTERVAL instructions (5):MAX_K clusters (6):WARM_UP instructions" << std::endl;
+        std::cout << "      7 - functional threaded, then save checkpoint to (4):CHECKPOINT_FILE" << std::endl;
+        std::cout << "      8 - batch performance, FILE_NAME is a job list, NUM_CYCLES is the number of threads (0 - all cores)" << std::endl;
+        std::cout << "      9 - performance sweep, (4):THREADS, KEY=V1,V2,... arguments are the grid axes" << std::endl;
+        std::cout << "      10 - functional threaded with LRU miss-ratio curves up to (4):MAX_SETS x (5):MAX_WAYS" << std::endl;
+        std::cout << "      11 - functional interpreter, write binary trace to (4):TRACE_FILE" << std::endl;
+        std::cout << "      12 - performance driven by (4):TRACE_FILE of the same program" << std::endl;
+        std::cout << "      13 - memory accessor benchmark on the loads and stores of (4):TRACE_FILE, (5):ROUNDS" << std::endl;
+        std::cout << "Config: config=FILE and KEY=VALUE arguments, keys CACHE_WAY, CACHE_SET, CACHE_LINE," << std::endl;
+        std::cout << "        MEM_LATENCY, BEAT_LATENCY, BUS_WIDTH, CRITICAL_WORD_FIRST (0 or 1), MSHRS (0 - blocking)," << std::endl;
+        std::cout << "        STORE_BUFFER (entries, 0 - none)," << std::endl;
+        std::cout << "        ICACHE_POLICY, DCACHE_POLICY (FIFO, LRU, PLRU, SRRIP, BRRIP, RANDOM)," << std::endl;
+        std::cout << "        ICACHE_PREFETCHER, DCACHE_PREFETCHER (NONE, NEXT_LINE, STRIDE, STREAM), PREFETCH_DEGREE," << std::endl;
+        std::cout << "        (prefetches leave one MSHR free; with MSHRS 0 or 1 they only start in idle cycles)," << std::endl;
+        std::cout << "        BRANCH_PREDICTOR (NONE, STATIC, BIMODAL, GSHARE, TAGE), BTB_ENTRIES, PREDICTOR_ENTRIES," << std::endl;
+        std::cout << "        HISTORY_LENGTH (1 - 64), RAS_DEPTH (entries, 0 - none)," << std::endl;
+        std::cout << "        BRANCH_RESOLUTION (DECODE, EXECUTE, MEMORY)," << std::endl;
+        std::cout << "        CACHE_LEVELS (1 - 3), L2_ and L3_ WAY, SET, LINE, LATENCY, POLICY," << std::endl;
+        std::cout << "        INCLUSION (INCLUSIVE, EXCLUSIVE, NINE)" << std::endl;
         return -1;
     }
-    ElfManager elfManager(argv[1]);
     int num_cycles = atoi(argv[2]);
     int is_fsim = 0;
-    if (argc == 4)
+    if (argc >= 4)
         is_fsim = atoi(argv[3]);
 
-    if (is_fsim) {
-        FuncSim simulator(elfManager.getWords(), elfManager.getPC());
+    Config config;
+    std::vector<std::string> axes;
+    for (const auto& assignment : assignments) {
+        if (assignment.compare(0, 7, "config=") == 0)
+            config.load(assignment.c_str() + 7);
+        else if (is_fsim == 9)
+            axes.push_back(assignment);
+        else
+            config.set(assignment);
+    }
+    config.validate();
+
+    if (is_fsim == 8) {
+        BatchRunner runner(BatchRunner::read_jobs(argv[1], config), num_cycles);
+        runner.run();
+        return 0;
+    }
+
+    if (is_fsim == 9) {
+        BatchRunner::Job base;
+        base.file_name = argv[1];
+        base.instructions = num_cycles;
+        base.config = config;
+        size_t num_threads = (argc >= 5) ? atoi(argv[4]) : 0;
+        BatchRunner runner(BatchRunner::expand_sweep(base, axes), num_threads);
+        runner.run();
+        return 0;
+    }
+
+    // A checkpoint restores registers on top of what the simulators set up.
+    Checkpoint checkpoint = Checkpoint::load_program(argv[1]);
+    if (checkpoint.is_restored)
+        std::cout << std::dec << "Restored checkpoint at " << checkpoint.instructions << " instructions" << std::endl;
+    auto restore = [&](auto& simulator) {
+        if (checkpoint.is_restored)
+            simulator.set_registers(checkpoint.registers);
+    };
+
+    if (is_fsim == 11 || is_fsim == 12 || is_fsim == 13) {
+        if (argc < 5) {
+            std::cout << "Trace modes require (4):TRACE_FILE" << std::endl;
+            return -1;
+        }
+    }
+
+    if (is_fsim == 11) {
+        trace::Writer writer(argv[4]);
+        FuncSim simulator(checkpoint.pages, checkpoint.PC);
+        restore(simulator);
+        simulator.set_trace(false);
+        simulator.set_trace_writer(&writer);
+        simulator.run(num_cycles);
+        writer.close();
+        writer.print_stats();
+    } else if (is_fsim == 12) {
+        trace::Reader reader(argv[4]);
+        PerfSim simulator(checkpoint.pages, checkpoint.PC, config);
+        restore(simulator);
+        simulator.set_replay(&reader);
+        simulator.run(num_cycles);
+    } else if (is_fsim == 13) {
+        trace::Reader reader(argv[4]);
+        uint32_t rounds = (argc >= 6) ? atoi(argv[5]) : 100;
+        MemoryBenchmark benchmark(checkpoint.pages, reader, num_cycles);
+        benchmark.run(rounds, config.cache_line);
+    } else if (is_fsim == 10) {
+        uint32_t max_sets = (argc >= 5) ? atoi(argv[4]) : 1024;
+        uint32_t max_ways = (argc >= 6) ? atoi(argv[5]) : 16;
+        StackDistance icache(config.cache_line, max_sets, max_ways);
+        StackDistance dcache(config.cache_line, max_sets, max_ways);
+        FuncSim simulator(checkpoint.pages, checkpoint.PC, FuncSim::Engine::THREADED);
+        restore(simulator);
+        simulator.set_warmers(&icache, &dcache);
+        simulator.run(num_cycles);
+        icache.print_stats("icache");
+        dcache.print_stats("dcache");
+    } else if (is_fsim == 7) {
+        if (argc < 5) {
+            std::cout << "Checkpoint mode requires (4):CHECKPOINT_FILE" << std::endl;
+            return -1;
+        }
+        FuncSim simulator(checkpoint.pages, checkpoint.PC, FuncSim::Engine::THREADED);
+        restore(simulator);
+        simulator.run(num_cycles);
+        checkpoint.PC = simulator.get_PC();
+        checkpoint.instructions += num_cycles;
+        checkpoint.registers = simulator.get_registers();
+        checkpoint.pages = simulator.get_memory_pages();
+        checkpoint.save(argv[4]);
+        std::cout << std::dec << "Saved checkpoint at " << checkpoint.instructions << " instructions" << std::endl;
+    } else if (is_fsim == 6) {
+        SimPointSim::Params params;
+        if (argc >= 5)
+            params.interval = strtoull(argv[4], nullptr, 10);
+        if (argc >= 6)
+            params.max_k = atoi(argv[5]);
+        if (argc >= 7)
+            params.warm_up = atoi(argv[6]);
+        SimPointSim simulator(checkpoint.pages, checkpoint.PC, params, config);
+        restore(simulator);
+        simulator.run(num_cycles);
+    } else if (is_fsim == 5) {
+        SamplingSim::Params params;
+        if (argc >= 5)
+            params.period = strtoull(argv[4], nullptr, 10);
+        if (argc >= 6)
+            params.warm_up = atoi(argv[5]);
+        if (argc >= 7)
+            params.measure = atoi(argv[6]);
+        SamplingSim simulator(checkpoint.pages, checkpoint.PC, params, config);
+        restore(simulator);
+        simulator.run(num_cycles);
+    } else if (is_fsim == 4) {
+        uint64_t fast_forward = (argc >= 5) ? strtoull(argv[4], nullptr, 10) : 0;
+        HybridSim simulator(checkpoint.pages, checkpoint.PC, config);
+        restore(simulator);
+        simulator.run(fast_forward, num_cycles);
+    } else if (is_fsim) {
+        auto engine = FuncSim::Engine::INTERPRETER;
+        if (is_fsim == 2)
+            engine = FuncSim::Engine::THREADED;
+        else if (is_fsim == 3)
+            engine = FuncSim::Engine::JIT;
+        FuncSim simulator(checkpoint.pages, checkpoint.PC, engine);
+        restore(simulator);
         simulator.run(num_cycles);
+        simulator.print_stats();
     } else {
-        PerfSim simulator(elfManager.getWords(), elfManager.getPC());
+        PerfSim simulator(checkpoint.pages, checkpoint.PC, config);
+        restore(simulator);
         simulator.run(num_cycles);
     }
     return 0;
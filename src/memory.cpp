@@ -1,46 +1,92 @@
 #include "memory.h"
 
-void PerfsimMemory::process() {
-    if (request.cycles_left == 0) {
-        if (request.request_type == request_type::read)
-            request.data = read(request.addr, request.num_bytes);
-        else
-            write(request.data, request.addr, request.num_bytes);
+#include <algorithm>
+
+static const Memory::Page zero_page = {};
 
-        request.is_completed = true;
-        request_result.is_ready = true;
-        request_result.data = request.data;
+Memory::Memory(const Pages& image) {
+    for (const auto& page : image) {
+        auto& table = directory[page.first / TABLE_SIZE];
+        if (table == nullptr)
+            table = std::make_unique<Table>();
+        (*table)[page.first % TABLE_SIZE] = page.second;
     }
 }
 
-void PerfsimMemory::send_read_request(uint32_t addr, size_t num_bytes) {
-    request.request_type = request_type::read;
-    request.is_completed = false;
-    request.cycles_left = latency;
-    request.num_bytes = num_bytes;
-    request.addr = addr;
-    request.data = 0xBAAAAAAD;
+const uint8_t* Memory::find_page(uint32_t page_num) const {
+    const auto& table = directory[page_num / TABLE_SIZE];
+    if (table == nullptr || (*table)[page_num % TABLE_SIZE] == nullptr)
+        return zero_page.data();
+    return (*table)[page_num % TABLE_SIZE]->data();
 }
 
-void PerfsimMemory::send_write_request(uint32_t value, uint32_t addr, size_t num_bytes) {
-    request.request_type = request_type::write;
-    request.is_completed = false;
-    request.cycles_left = latency;
-    request.num_bytes = num_bytes;
-    request.addr = addr;
-    request.data = value;
+uint8_t* Memory::get_writable_page(uint32_t page_num) {
+    auto& table = directory[page_num / TABLE_SIZE];
+    if (table == nullptr)
+        table = std::make_unique<Table>();
+    auto& page = (*table)[page_num % TABLE_SIZE];
+    if (page == nullptr)
+        page = std::make_shared<Page>();
+    else if (page.use_count() > 1)
+        page = std::make_shared<Page>(*page);
+    return page->data();
 }
 
-void PerfsimMemory::clock() {
-    request_result.is_ready = false;
-    request_result.data = 0xBAAAAAAD;
+Memory::Pages Memory::get_pages() const {
+    Pages pages;
+    for (uint32_t i = 0; i < directory.size(); i++) {
+        if (directory[i] == nullptr)
+            continue;
+        for (uint32_t j = 0; j < TABLE_SIZE; j++)
+            if ((*directory[i])[j] != nullptr)
+                pages.emplace(i * TABLE_SIZE + j, (*directory[i])[j]);
+    }
+    // The pages are shared now, the next write has to copy.
+    write_page_num = NO_VAL32;
+    write_page = nullptr;
+    return pages;
+}
 
+void Memory::dump() {
+    for (const auto& page : get_pages()) {
+        std::cout << std::hex << (page.first << PAGE_BITS) << ": ";
+        for (uint8_t byte : *page.second)
+            std::cout << byte;
+        std::cout << std::endl;
+    }
+}
 
-    if (request.is_completed) {
-        return;
+void PerfsimMemory::start(request_type::Request type, uint32_t addr, uint8_t* line, uint32_t num_bytes, uint32_t first_offset) {
+    burst.request_type = type;
+    burst.addr = addr;
+    burst.line = line;
+    burst.num_bytes = num_bytes;
+    burst.first_offset = first_offset;
+    burst.cycles_left = latency;
+    status = BurstStatus{0, false};
+    is_owned = true;
+}
+
+void PerfsimMemory::transfer_beat() {
+    const uint32_t offset = (burst.first_offset + status.bytes_done) % burst.num_bytes;
+    for (uint32_t i = 0; i < bus_width; i += 4) {
+        const uint32_t width = std::min(bus_width - i, 4u);
+        if (burst.request_type == request_type::read)
+            store_bytes(burst.line + offset + i, read(burst.addr + offset + i, width), width);
+        else
+            write(load_bytes(burst.line + offset + i, width), burst.addr + offset + i, width);
     }
 
-    request.cycles_left -= 1;
-    
-    process();
+    status.bytes_done += bus_width;
+    status.is_completed = status.bytes_done == burst.num_bytes;
+    burst.cycles_left = beat_latency;
+}
+
+void PerfsimMemory::clock() {
+    if (status.is_completed)
+        return;
+
+    burst.cycles_left -= 1;
+    if (burst.cycles_left == 0)
+        transfer_beat();
 }
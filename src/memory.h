@@ -1,9 +1,15 @@
 #ifndef MEMORY_H
 #define MEMORY_H
 
+#include <array>
+#include <map>
+#include <memory>
 #include <vector>
+#include <iostream>
 
 #include "instruction.h"
+#include "byte_access.h"
+#include "line_port.h"
 #include "consts.h"
 
 namespace request_type {
@@ -14,36 +20,105 @@ namespace request_type {
 }
 
 class Memory {
+public:
+    static const uint32_t PAGE_BITS = 12;
+    static const uint32_t PAGE_SIZE = 1u << PAGE_BITS;
+    using Page = std::array<uint8_t, PAGE_SIZE>;
+    // Sparse memory image by page number. Pages are shared between images
+    // and memories and copied on first write.
+    using Pages = std::map<uint32_t, std::shared_ptr<Page>>;
+
 private:
-    std::vector<uint8_t> data;
-    
+    static const uint32_t TABLE_BITS = 10;
+    static const uint32_t TABLE_SIZE = 1u << TABLE_BITS;
+    static const uint32_t STACK_TOP = 0u - 32;
+
+    // Two-level page table over the whole 32-bit space; tables and pages
+    // are allocated on first write, untouched memory reads as zero.
+    using Table = std::array<std::shared_ptr<Page>, TABLE_SIZE>;
+    std::array<std::unique_ptr<Table>, (1u << (32 - PAGE_BITS)) / TABLE_SIZE> directory;
+
+    // Last page looked up, for reads and for writes. The write entry only
+    // ever holds a page this memory owns exclusively.
+    mutable uint32_t read_page_num = NO_VAL32;
+    mutable const uint8_t* read_page = nullptr;
+    mutable uint32_t write_page_num = NO_VAL32;
+    mutable uint8_t* write_page = nullptr;
+
+    const uint8_t* find_page(uint32_t page_num) const;
+    uint8_t* get_writable_page(uint32_t page_num);
+
+    const uint8_t* get_read_page(uint32_t page_num) const {
+        if (page_num != read_page_num) {
+            read_page = find_page(page_num);
+            read_page_num = page_num;
+        }
+        return read_page;
+    }
+    uint8_t* get_write_page(uint32_t page_num) {
+        if (page_num != write_page_num) {
+            write_page = get_writable_page(page_num);
+            write_page_num = page_num;
+            read_page = write_page;
+            read_page_num = page_num;
+        }
+        return write_page;
+    }
+
 public:
+    // Fixed-width accesses; only those crossing a page go byte by byte.
+    template <size_t N>
+    uint32_t read(uint32_t addr) const {
+        const uint32_t offset = addr & (PAGE_SIZE - 1);
+        if (N > 1 && offset + N > PAGE_SIZE)
+            return read_bytewise(addr, N);
+        return load_bytes<N>(get_read_page(addr >> PAGE_BITS) + offset);
+    }
+    template <size_t N>
+    void write(uint32_t value, uint32_t addr) {
+        const uint32_t offset = addr & (PAGE_SIZE - 1);
+        if (N > 1 && offset + N > PAGE_SIZE) {
+            write_bytewise(value, addr, N);
+            return;
+        }
+        store_bytes<N>(get_write_page(addr >> PAGE_BITS) + offset, value);
+    }
+
     uint32_t read(uint32_t addr, size_t num_bytes) const {
-        uint32_t value = 0;
-        for (uint i = 0; i < num_bytes; ++i) {
-            uint8_t byte = data[addr + i];
-            value |= static_cast<uint32_t>(byte) << (8*i);
+        switch (num_bytes) {
+            case 1: return read<1>(addr);
+            case 2: return read<2>(addr);
+            case 4: return read<4>(addr);
+            default: return read_bytewise(addr, num_bytes);
         }
-        return value;
     }
     void write(uint32_t value, uint32_t addr, size_t num_bytes) {
-        for (uint i = 0; i < num_bytes; ++i) {
-            uint8_t byte = static_cast<uint8_t>(value >> 8*i); 
-            data[addr + i] = byte;
+        switch (num_bytes) {
+            case 1: write<1>(value, addr); break;
+            case 2: write<2>(value, addr); break;
+            case 4: write<4>(value, addr); break;
+            default: write_bytewise(value, addr, num_bytes); break;
         }
     }
 
-    Memory(std::vector<uint8_t> data) :
-        data(std::move(data)) { 
-        this->data.resize(400000, 0);
+    // One byte at a time; page-crossing accesses and benchmark reference.
+    uint32_t read_bytewise(uint32_t addr, size_t num_bytes) const {
+        uint32_t value = 0;
+        for (uint i = 0; i < num_bytes; ++i)
+            value |= static_cast<uint32_t>(get_read_page((addr + i) >> PAGE_BITS)[(addr + i) & (PAGE_SIZE - 1)]) << (8*i);
+        return value;
     }
-    uint32_t get_stack_pointer() const { return (data.size() - 1) & ~(32 - 1); }
-
-    void dump() {
-        for (size_t i = 0; i < data.size(); i++)
-            std::cout << data[i];
-        std::cout << std::endl;
+    void write_bytewise(uint32_t value, uint32_t addr, size_t num_bytes) {
+        for (uint i = 0; i < num_bytes; ++i)
+            get_write_page((addr + i) >> PAGE_BITS)[(addr + i) & (PAGE_SIZE - 1)] = static_cast<uint8_t>(value >> 8*i);
     }
+
+    explicit Memory(const Pages& image);
+    // Snapshot sharing the current pages.
+    Pages get_pages() const;
+    uint32_t get_stack_pointer() const { return STACK_TOP; }
+
+    void dump();
 };
 
 
@@ -59,9 +134,9 @@ private:
     }     
 
 public:
-    FuncsimMemory(std::vector<uint8_t> data) : Memory(data) { }
+    FuncsimMemory(const Pages& image) : Memory(image) { }
 
-    uint32_t read_word(uint32_t addr) { return read(addr, 4); }
+    uint32_t read_word(uint32_t addr) { return read<4>(addr); }
     void load_store(Instruction& instr) {
         if (instr.is_load())
             load(instr);
@@ -71,43 +146,54 @@ public:
 };
 
 
-class PerfsimMemory : public Memory {
-public:
-    struct RequestResult {
-        bool is_ready = false;
-        uint32_t data = 0xBAAAAAAD;
-    };
-
+// Memory side of the cache bus. A line moves as one burst of BUS_WIDTH
+// beats: the first beat arrives after the access latency, every further
+// one after the beat latency. Read bursts may start at the critical beat
+// and wrap around the line. The bus belongs to the cache that started a
+// burst until it calls release().
+class PerfsimMemory : public Memory, public LinePort {
 private:
-    struct Request {
-        bool is_completed = true;
-        request_type::Request request_type;
+    struct Burst {
+        request_type::Request request_type = request_type::read;
         uint32_t addr = 0xBAAAAAAD;
-        uint32_t data = 0xBAAAAAAD;
-        size_t num_bytes = 0xBAAAAAAD;
+        uint8_t* line = nullptr;
+        uint32_t num_bytes = 0;
+        uint32_t first_offset = 0;
         uint32_t cycles_left = 0;
     };
 
-    Request request;
-    RequestResult request_result;
+    Burst burst;
+    BurstStatus status;
+    bool is_owned = false;
 
     uint32_t latency = 0;
+    uint32_t beat_latency = 0;
+    uint32_t bus_width = 0;
 
-    void process();
+    void start(request_type::Request type, uint32_t addr, uint8_t* line, uint32_t num_bytes, uint32_t first_offset);
+    void transfer_beat();
 
 public:
-    PerfsimMemory(std::vector<uint8_t> data, uint32_t latency):
-        Memory(data),
-        latency(latency)
+    PerfsimMemory(const Pages& image, uint32_t latency, uint32_t beat_latency, uint32_t bus_width):
+        Memory(image),
+        latency(latency),
+        beat_latency(beat_latency),
+        bus_width(bus_width)
     {}
 
     void clock();
-    bool is_busy() { 
-        return !request.is_completed; 
+    bool is_busy() const override { return is_owned; }
+    void release() override { is_owned = false; }
+    uint32_t get_bus_width() const override { return bus_width; }
+    bool is_exclusive() const override { return false; }
+
+    void send_read_burst(uint32_t addr, uint8_t* line, uint32_t num_bytes, uint32_t first_offset) override {
+        start(request_type::read, addr, line, num_bytes, first_offset);
+    }
+    void send_write_burst(uint32_t addr, uint8_t* line, uint32_t num_bytes, bool) override {
+        start(request_type::write, addr, line, num_bytes, 0);
     }
-    void send_read_request(uint32_t addr, size_t num_bytes);
-    void send_write_request(uint32_t value, uint32_t addr, size_t num_bytes);
-    RequestResult get_request_status() { return request_result; }
+    BurstStatus get_burst_status() const override { return status; }
 };
 
 #endif
@@ -0,0 +1,99 @@
+#include "memory_benchmark.h"
+#include "byte_access.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+MemoryBenchmark::MemoryBenchmark(const Memory::Pages& image, trace::Reader& reader, uint64_t num_instructions):
+    image(image)
+{
+    for (uint64_t i = 0; i < num_instructions && reader.peek() != nullptr; i++, reader.advance()) {
+        const trace::Record& record = *reader.peek();
+        if (!record.is_memory)
+            continue;
+        Instruction instr(record.raw_bytes, record.PC);
+        accesses.push_back({record.memory_addr, static_cast<uint8_t>(instr.get_memory_size()), instr.is_store()});
+    }
+}
+
+// Every round starts from the original image, so stores copy their pages
+// again and both variants see the same work.
+template <typename Replay>
+double MemoryBenchmark::time_ns(uint32_t rounds, Replay replay) const {
+    uint32_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < rounds; i++)
+        checksum += replay();
+    auto finish = std::chrono::steady_clock::now();
+
+    // Keeps the loads alive.
+    volatile uint32_t sink = checksum;
+    (void)sink;
+    return std::chrono::duration<double, std::nano>(finish - start).count() / (double(rounds) * accesses.size());
+}
+
+void MemoryBenchmark::run(uint32_t rounds, uint32_t line_size_in_bytes) const {
+    std::cout << std::dec << "Accesses: " << accesses.size() << ", rounds: " << rounds << std::endl;
+    if (accesses.empty())
+        return;
+
+    double memory_bytewise = time_ns(rounds, [&]() {
+        Memory memory(image);
+        uint32_t checksum = 0;
+        for (const auto& access : accesses) {
+            if (access.is_store)
+                memory.write_bytewise(access.addr, access.addr, access.num_bytes);
+            else
+                checksum += memory.read_bytewise(access.addr, access.num_bytes);
+        }
+        return checksum;
+    });
+    double memory_width = time_ns(rounds, [&]() {
+        Memory memory(image);
+        uint32_t checksum = 0;
+        for (const auto& access : accesses) {
+            if (access.is_store)
+                memory.write(access.addr, access.addr, access.num_bytes);
+            else
+                checksum += memory.read(access.addr, access.num_bytes);
+        }
+        return checksum;
+    });
+
+    // Offsets are clamped so unaligned guest accesses stay inside the line.
+    std::vector<uint8_t> line(line_size_in_bytes);
+    auto get_offset = [&](const Access& access) {
+        uint32_t offset = access.addr & (line_size_in_bytes - 1);
+        return std::min(offset, line_size_in_bytes - access.num_bytes);
+    };
+    double line_bytewise = time_ns(rounds, [&]() {
+        uint32_t checksum = 0;
+        for (const auto& access : accesses) {
+            if (access.is_store)
+                store_bytewise(&line[get_offset(access)], access.addr, access.num_bytes);
+            else
+                checksum += load_bytewise(&line[get_offset(access)], access.num_bytes);
+        }
+        return checksum;
+    });
+    double line_width = time_ns(rounds, [&]() {
+        uint32_t checksum = 0;
+        for (const auto& access : accesses) {
+            if (access.is_store)
+                store_bytes(&line[get_offset(access)], access.addr, access.num_bytes);
+            else
+                checksum += load_bytes(&line[get_offset(access)], access.num_bytes);
+        }
+        return checksum;
+    });
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Memory byte-wise: " << memory_bytewise << " ns/access" << std::endl;
+    std::cout << "Memory width-templated: " << memory_width << " ns/access" << std::endl;
+    std::cout << "Memory speedup: " << memory_bytewise / memory_width << std::endl;
+    std::cout << "Cache line byte-wise: " << line_bytewise << " ns/access" << std::endl;
+    std::cout << "Cache line width-templated: " << line_width << " ns/access" << std::endl;
+    std::cout << "Cache line speedup: " << line_bytewise / line_width << std::endl;
+}
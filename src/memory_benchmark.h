@@ -0,0 +1,32 @@
+#ifndef MEMORY_BENCHMARK_H
+#define MEMORY_BENCHMARK_H
+
+#include <vector>
+
+#include "memory.h"
+#include "trace.h"
+
+// Replays the loads and stores of a binary trace against guest memory and
+// a cache line buffer, once with the byte-wise accessors and once with the
+// width-templated ones, and reports the time per access of each.
+class MemoryBenchmark {
+private:
+    struct Access {
+        uint32_t addr = 0;
+        uint8_t num_bytes = 0;
+        bool is_store = false;
+    };
+
+    Memory::Pages image;
+    std::vector<Access> accesses;
+
+    template <typename Replay>
+    double time_ns(uint32_t rounds, Replay replay) const;
+
+public:
+    MemoryBenchmark(const Memory::Pages& image, trace::Reader& reader, uint64_t num_instructions);
+
+    void run(uint32_t rounds, uint32_t line_size_in_bytes) const;
+};
+
+#endif
@@ -1,16 +1,60 @@
 #include "mmu.h"
 
-MMU::MMU(const std::vector<uint8_t>& data):
-    memory(data, MEM_LATENCY),
-    icache(memory, CACHE_WAY, CACHE_SET, CACHE_LINE),
-    dcache(memory, CACHE_WAY, CACHE_SET, CACHE_LINE) {}
+#include <cassert>
 
+MMU::MMU(const Memory::Pages& image, const Config& config):
+    memory(image, config.mem_latency, config.beat_latency, config.bus_width),
+    levels(build_levels(memory, config)),
+    icache(memory, get_l1_next_level(), config.cache_way, config.cache_set, config.cache_line, config.icache_policy, config.critical_word_first, config.mshrs,
+           config.icache_prefetcher, config.prefetch_degree),
+    dcache(memory, get_l1_next_level(), config.cache_way, config.cache_set, config.cache_line, config.dcache_policy, config.critical_word_first, config.mshrs,
+           config.dcache_prefetcher, config.prefetch_degree)
+{
+    for (size_t i = 1; i < levels.size(); i++)
+        levels[i]->add_upper_level(*levels[i - 1]);
+    if (!levels.empty()) {
+        levels.front()->add_upper_level(icache);
+        levels.front()->add_upper_level(dcache);
+    }
+}
+
+std::vector<std::unique_ptr<UnifiedCache>> MMU::build_levels(PerfsimMemory& memory, const Config& config) {
+    std::vector<std::unique_ptr<UnifiedCache>> levels;
+    LinePort* next_level = &memory;
+    for (uint32_t number = config.cache_levels; number > 1; number--) {
+        const auto level = config.get_level(number);
+        levels.insert(levels.begin(), std::make_unique<UnifiedCache>(*next_level, level.way, level.set, level.line,
+                      level.latency, config.beat_latency, level.policy, level.inclusion));
+        next_level = levels.front().get();
+    }
+    return levels;
+}
+
+// Lower levels first, so a burst sent from above starts on the next cycle
+// at every level.
 void MMU::clock() {
    memory.clock();
+   for (auto level = levels.rbegin(); level != levels.rend(); ++level)
+       (*level)->clock();
    icache.clock();
    dcache.clock();
 }
 
+void MMU::warm_up(const HierarchyWarmer& warmer) {
+    assert(warmer.levels.size() == levels.size());
+    icache.warm_up(warmer.icache);
+    dcache.warm_up(warmer.dcache);
+    for (size_t i = 0; i < levels.size(); i++)
+        levels[i]->warm_up(*warmer.levels[i], memory);
+}
+
+void MMU::print_stats() const {
+    icache.print_stats("icache");
+    dcache.print_stats("dcache");
+    for (size_t i = 0; i < levels.size(); i++)
+        levels[i]->print_stats(("L" + std::to_string(i + 2)).c_str());
+}
+
 void MMU::dump() { 
     if (!IS_DUMP_MEM)
         return;
@@ -20,7 +64,7 @@ void MMU::dump() {
 
 bool MMU::fetch(bool& is_request, uint32_t PC, uint32_t& data) {
    if (!is_request) {
-       icache.send_read_request(PC, 4);
+       icache.send_read_request(PC, 4, PC);
        is_request = true;
    }
 
@@ -34,13 +78,13 @@ bool MMU::fetch(bool& is_request, uint32_t PC, uint32_t& data) {
    return false;
 }
 
-void MMU::process_load(uint32_t addr, size_t num_bytes) {
-    dcache.send_read_request(addr, num_bytes);
+void MMU::process_load(uint32_t addr, size_t num_bytes, bool is_first_piece, uint32_t PC) {
+    dcache.send_read_request(addr, num_bytes, PC, is_first_piece);
 }
 
-void MMU::process_store(uint32_t data, uint32_t addr, size_t num_bytes, bool is_complete) {
+void MMU::process_store(uint32_t data, uint32_t addr, size_t num_bytes, bool is_complete, uint32_t PC) {
     if (is_complete)
-        dcache.send_write_request(data, addr, num_bytes);
+        dcache.send_write_request(data, addr, num_bytes, PC, true);
     else
-        dcache.send_write_request(data >> 16, addr, num_bytes);
+        dcache.send_write_request(data >> 16, addr, num_bytes, PC, false);
 }
@@ -1,22 +1,35 @@
 #ifndef PSIM_MMU_H
 #define PSIM_MMU_H
 
+#include <memory>
 #include <vector>
 
 #include "memory.h"
 #include "cache.h"
+#include "unified_cache.h"
 #include "consts.h"
+#include "config.h"
 
 class MMU {
 private:
     PerfsimMemory memory;
+    // L2 first; each level fetches from the one after it, the last one
+    // from memory.
+    std::vector<std::unique_ptr<UnifiedCache>> levels;
     Cache icache;
     Cache dcache;
 
+    static std::vector<std::unique_ptr<UnifiedCache>> build_levels(PerfsimMemory& memory, const Config& config);
+    LinePort& get_l1_next_level() { return levels.empty() ? static_cast<LinePort&>(memory) : *levels.front(); }
+
 public:
-    MMU(const std::vector<uint8_t>& data);
+    MMU(const Memory::Pages& image, const Config& config);
 
     void dump();
+    void print_stats() const;
+    Cache::Stats get_icache_stats() const { return icache.get_stats(); }
+    Cache::Stats get_dcache_stats() const { return dcache.get_stats(); }
+    void warm_up(const HierarchyWarmer& warmer);
 
     void clock();
     uint32_t getSP() { return memory.get_stack_pointer(); }
@@ -24,8 +37,10 @@ public:
     bool is_icache_busy() { return icache.is_busy(); }
     bool is_dcache_busy() { return dcache.is_busy(); }
     bool fetch(bool& is_request, uint32_t PC, uint32_t& data);
-    void process_load(uint32_t addr, size_t num_bytes);
-    void process_store(uint32_t data, uint32_t addr, size_t num_bytes, bool is_complete);
+    // Word accesses reach the dcache as two 2-byte pieces; only the first
+    // one trains the prefetcher.
+    void process_load(uint32_t addr, size_t num_bytes, bool is_first_piece, uint32_t PC);
+    void process_store(uint32_t data, uint32_t addr, size_t num_bytes, bool is_complete, uint32_t PC);
     Cache::RequestResult memory_request_status() { return dcache.get_request_status(); } 
 };
 
@@ -1,10 +1,16 @@
 #include "perfsim.h"
 #include "consts.h"
 
-PerfSim::PerfSim(std::vector<uint8_t>& data, uint32_t PC): 
-    mmu(data),
+#include <cstdlib>
+#include <err.h>
+
+PerfSim::PerfSim(const Memory::Pages& image, uint32_t PC, const Config& config): 
+    mmu(image, config),
+    store_buffer(mmu, config.store_buffer),
+    bpu(config.branch_predictor, config.btb_entries, config.predictor_entries, config.history_length, config.ras_depth),
     rf(),
     PC(PC),
+    branch_resolution(config.branch_resolution),
     clocks(0),
     ops(0)
 {
@@ -18,9 +24,13 @@ PerfSim::PerfSim(std::vector<uint8_t>& data, uint32_t PC):
 
 void PerfSim::step() {
     mmu.clock();
+    store_buffer.retire();
 
     writeback_stage();
     memory_stage();
+    if (!memory_awaiting_memory_request && !is_memory_stage_request)
+        store_buffer.drain();
+    is_memory_stage_request = false;
     execute_stage();
     decode_stage();
     fetch_stage();
@@ -46,18 +56,38 @@ void PerfSim::step() {
     hu.reset();
 }
 
-void PerfSim::run(uint32_t n) {
-    while (ops < n)
+HazardUnit::Stage PerfSim::get_resolution_stage(const Instruction& instr) const {
+    if (!instr.is_jump() && !instr.is_branch())
+        return HazardUnit::MAX;
+    if (branch_resolution == HazardUnit::DECODE && !instr.is_direct_jump())
+        return HazardUnit::EXECUTE;
+    return static_cast<HazardUnit::Stage>(branch_resolution);
+}
+
+void PerfSim::resolve(const Instruction& instr, HazardUnit::Stage stage) {
+    if (bpu.is_enabled())
+        bpu.update(instr);
+    if (instr.get_new_PC() != instr.get_predicted_PC())
+        hu.set_mispredict(instr.get_new_PC(), stage);
+}
+
+void PerfSim::simulate(uint32_t n) {
+    while (ops < n && !is_replay_done())
         step();
+}
+
+void PerfSim::run(uint32_t n) {
+    simulate(n);
 
     visual.print_file();
     hu.print_stats(clocks, ops);
+    mmu.print_stats();
+    store_buffer.print_stats();
+    bpu.print_stats(ops);
 }
 
 void PerfSim::fetch_stage() {
     Visualizer::Record record;
-    static bool awaiting_memory_request = false;
-    static uint32_t fetch_data = NO_VAL32;
 
     if (hu.check_stall_FD()) {
         record.is_stall = true;
@@ -67,7 +97,8 @@ void PerfSim::fetch_stage() {
     }
     
     if (hu.is_mispredict()) {
-        awaiting_memory_request = false;
+        fetch_awaiting_memory_request = false;
+        is_replay_wrong_path = false;
         record.is_flush = true;
         PC = hu.get_real_PC();
     }
@@ -81,7 +112,7 @@ void PerfSim::fetch_stage() {
         return;
     }
 
-    bool fetch_complete = mmu.fetch(awaiting_memory_request, PC, fetch_data);
+    bool fetch_complete = mmu.fetch(fetch_awaiting_memory_request, PC, fetch_data);
 
     record.raw_bytes = fetch_data;
 
@@ -89,13 +120,33 @@ void PerfSim::fetch_stage() {
         if ((fetch_data == 0 ) | (fetch_data == NO_VAL32)) {
             latch.FETCH_DECODE.write(nullptr);
             record.is_empty = true;
+        } else if (replay != nullptr && !is_replay_wrong_path && replay->peek() == nullptr) {
+            // Trace is over: drain the pipeline.
+            latch.FETCH_DECODE.write(nullptr);
+            record.is_empty = true;
         } else {
             hu.set_pipe_not_empty();
-            Instruction* data = new Instruction(fetch_data, PC);
+            BranchPredictor::Prediction prediction;
+            prediction.next_PC = PC + 4;
+            if (bpu.is_enabled())
+                prediction = bpu.predict(PC);
+            Instruction* data = nullptr;
+            if (replay != nullptr && !is_replay_wrong_path) {
+                const trace::Record* next = replay->peek();
+                if (next->PC != PC)
+                    errx(EXIT_FAILURE, "trace does not match the program at PC 0x%x", PC);
+                data = new Instruction(next->raw_bytes, PC);
+                data->replay(next->new_PC, next->memory_addr, next->rd_value);
+                is_replay_wrong_path = next->new_PC != prediction.next_PC;
+                replay->advance();
+                replayed++;
+            } else
+                data = new Instruction(fetch_data, PC);
+            data->set_prediction(prediction);
             record.instr = data->get_disasm();
 
             latch.FETCH_DECODE.write(data);
-            PC = PC + 4;
+            PC = prediction.next_PC;
         }
     } else {
         latch.FETCH_DECODE.write(nullptr);
@@ -137,6 +188,14 @@ void PerfSim::decode_stage() {
     if (hu.is_data_hazard_decode(static_cast<uint32_t>(data->get_rs1()), static_cast<uint32_t>(data->get_rs2())))
         latch.DECODE_EXE.write(nullptr);
     else {
+        // The target of jal is known here. A held instruction comes back
+        // next cycle, so it resolves once it moves on.
+        if (get_resolution_stage(*data) == HazardUnit::DECODE && !hu.is_stall_FD()) {
+            if (!data->is_complete())
+                data->execute();
+            resolve(*data, HazardUnit::DECODE);
+            record.is_flush = hu.is_mispredict();
+        }
         rf.read_sources(*data);
         auto bypass_info = fu.read_sources(*data);
         if (bypass_info == 3) {
@@ -177,12 +236,19 @@ void PerfSim::execute_stage() {
     }
     hu.set_pipe_not_empty();
     
-    data->execute();
+    // Replayed instructions already carry their outcome.
+    if (!data->is_complete())
+        data->execute();
 
     //hu.set_reg_execute(static_cast<uint32_t>(data->get_rd())); //Not necessary
     fu.set_bypass_exe({static_cast<uint32_t>(data->get_rd()), data->get_rd_v()});
     latch.EXE_MEM.write(data);
 
+    if (get_resolution_stage(*data) == HazardUnit::EXECUTE && !hu.is_stall_DE()) {
+        resolve(*data, HazardUnit::EXECUTE);
+        record.is_flush = hu.is_mispredict();
+    }
+
     record.PC = data->get_PC();
     record.instr = data->get_disasm();
 
@@ -191,9 +257,6 @@ void PerfSim::execute_stage() {
 
 void PerfSim::memory_stage() {
     Visualizer::Record record;
-    static uint32_t memory_stage_iterations_complete = 0;
-    static bool awaiting_memory_request = false;
-    static uint32_t memory_data = NO_VAL32;
 
     Instruction* data = nullptr;
     data = latch.EXE_MEM.read();
@@ -217,44 +280,77 @@ void PerfSim::memory_stage() {
 
     if (data->is_load() | data->is_store()) {
         record.is_memop = true;
-        if (mmu.is_dcache_busy()) {
-            hu.set_stall_memory();
-            latch.MEM_WB.write(nullptr);
-            record.is_dcache = true;
-            visual.record_memory(record);
-            return;
-        }
-
-        if (!awaiting_memory_request) {
-            uint32_t addr = data->get_memory_addr() + (memory_stage_iterations_complete * 2);
-            size_t num_bytes = (data->get_memory_size() == 1) ? 1 : 2;
-
-            if (data->is_load())
-                mmu.process_load(addr, num_bytes);
 
+        // Stores go into the store buffer, and loads it covers are served
+        // from it; neither waits for the dcache.
+        bool is_buffered = false;
+        if (store_buffer.is_enabled() && !memory_awaiting_memory_request && memory_stage_iterations_complete == 0) {
+            auto forward = StoreBuffer::Forward::NONE;
             if (data->is_store()) {
-                memory_data = data->get_rs2_v();
-                mmu.process_store(memory_data, addr, num_bytes, memory_stage_iterations_complete == 0);
+                if (store_buffer.is_full())
+                    store_buffer.count_full_stall();
+                else {
+                    memory_data = data->get_rs2_v();
+                    store_buffer.push(data->get_memory_addr(), memory_data, data->get_memory_size(), data->get_PC());
+                    is_buffered = true;
+                }
+            } else {
+                forward = store_buffer.forward(data->get_memory_addr(), data->get_memory_size(), memory_data);
+                is_buffered = forward == StoreBuffer::Forward::HIT;
+                if (forward == StoreBuffer::Forward::OVERLAP)
+                    store_buffer.count_overlap_stall();
             }
 
-            awaiting_memory_request = true;
+            if (!is_buffered && (data->is_store() || forward == StoreBuffer::Forward::OVERLAP)) {
+                hu.set_stall_memory();
+                latch.MEM_WB.write(nullptr);
+                record.is_dcache = true;
+                visual.record_memory(record);
+                return;
+            }
         }
 
-        auto request = mmu.memory_request_status();
+        if (!is_buffered) {
+            if (mmu.is_dcache_busy()) {
+                hu.set_stall_memory();
+                latch.MEM_WB.write(nullptr);
+                record.is_dcache = true;
+                visual.record_memory(record);
+                return;
+            }
+
+            if (!memory_awaiting_memory_request) {
+                uint32_t addr = data->get_memory_addr() + (memory_stage_iterations_complete * 2);
+                size_t num_bytes = (data->get_memory_size() == 1) ? 1 : 2;
+
+                if (data->is_load())
+                    mmu.process_load(addr, num_bytes, memory_stage_iterations_complete == 0, data->get_PC());
+
+                if (data->is_store()) {
+                    memory_data = data->get_rs2_v();
+                    mmu.process_store(memory_data, addr, num_bytes, memory_stage_iterations_complete == 0, data->get_PC());
+                }
 
-        if (request.is_ready) {
-            if (data->is_load()) {
-                if (memory_stage_iterations_complete == 0)
-                    memory_data = request.data;
-                else
-                    memory_data |= (request.data << 16);
+                memory_awaiting_memory_request = true;
+                is_memory_stage_request = true;
             }
 
-            awaiting_memory_request = false;
-            memory_stage_iterations_complete++;
+            auto request = mmu.memory_request_status();
+
+            if (request.is_ready) {
+                if (data->is_load()) {
+                    if (memory_stage_iterations_complete == 0)
+                        memory_data = request.data;
+                    else
+                        memory_data |= (request.data << 16);
+                }
+
+                memory_awaiting_memory_request = false;
+                memory_stage_iterations_complete++;
+            }
         }
 
-        bool memory_operation_complete = (memory_stage_iterations_complete * 2) >= data->get_memory_size();
+        bool memory_operation_complete = is_buffered || (memory_stage_iterations_complete * 2) >= data->get_memory_size();
 
         if (memory_operation_complete) {
             memory_stage_iterations_complete = 0;
@@ -273,9 +369,8 @@ void PerfSim::memory_stage() {
         fu.set_bypass_mem({static_cast<uint32_t>(data->get_rd()), data->get_rd_v()});
     }
 
-    if (data->is_jump() | data->is_branch())
-        if (data->get_new_PC() != data->get_PC() + 4)
-            hu.set_mispredict(data->get_new_PC());
+    if (get_resolution_stage(*data) == HazardUnit::MEMORY)
+        resolve(*data, HazardUnit::MEMORY);
 
     latch.MEM_WB.write(data);
 
@@ -301,7 +396,8 @@ void PerfSim::writeback_stage() {
     record.instr = data->get_disasm();
     visual.record_writeback(record);
     hu.set_pipe_not_empty();
-    std::cout << "0x" << std::hex << data->get_PC() << ": " << data->get_disasm() << " " << std::endl;
+    if (is_trace)
+        std::cout << "0x" << std::hex << data->get_PC() << ": " << data->get_disasm() << " " << std::endl;
     rf.writeback(*data);
     ops++;
     delete data;
@@ -6,23 +6,50 @@
 #include "latch.h"
 #include "elf.h"
 #include "consts.h"
+#include "config.h"
 #include "hazard_unit.h"
 #include "visualizer.h"
 #include "forwarding_unit.h"
+#include "trace.h"
+#include "store_buffer.h"
+#include "branch_predictor.h"
 
 class PerfSim {
 private:
     MMU mmu;
+    StoreBuffer store_buffer;
+    BranchPredictor bpu;
     RF rf;
     HazardUnit hu;
     ForwardingUnit fu;
     uint32_t PC;
+    uint32_t branch_resolution;
 
     Visualizer visual;
     
     uint32_t clocks;
     uint32_t ops;
 
+    bool is_trace = true;
+
+    // Trace-driven front end: correct-path instructions carry their outcome
+    // from the trace, fetches after a taken branch are wrong-path until the
+    // flush.
+    trace::Reader* replay = nullptr;
+    bool is_replay_wrong_path = false;
+    uint32_t replayed = 0;
+    bool is_replay_done() const { return replay != nullptr && replay->peek() == nullptr && ops == replayed; }
+
+    // Multi-cycle memory accesses in fetch and memory stages.
+    bool fetch_awaiting_memory_request = false;
+    uint32_t fetch_data = NO_VAL32;
+    bool memory_awaiting_memory_request = false;
+    uint32_t memory_stage_iterations_complete = 0;
+    uint32_t memory_data = NO_VAL32;
+    // The memory stage sent a dcache request this cycle, so the store
+    // buffer may not.
+    bool is_memory_stage_request = false;
+
     struct LatchStore {
         Latch FETCH_DECODE;
         Latch DECODE_EXE;
@@ -31,10 +58,36 @@ private:
     } latch;
 
 public:
-    PerfSim(std::vector<uint8_t>& data, uint32_t PC);
+    PerfSim(const Memory::Pages& image, uint32_t PC, const Config& config = Config());
     void run(uint32_t n);
+    // Same as run() but without the summary and pipeline dump.
+    void simulate(uint32_t n);
+
+    void set_replay(trace::Reader* reader) { replay = reader; }
+    void set_trace(bool value) {
+        is_trace = value;
+        hu.set_trace(value);
+    }
+    // Pipeline diagram records grow with every cycle; long runs turn them off.
+    void set_visual(bool value) { visual.set_enabled(value); }
+    HazardUnit::Stats get_stats() const { return hu.get_stats(clocks, ops); }
+    Cache::Stats get_icache_stats() const { return mmu.get_icache_stats(); }
+    Cache::Stats get_dcache_stats() const { return mmu.get_dcache_stats(); }
+    StoreBuffer::Stats get_store_buffer_stats() const { return store_buffer.get_stats(); }
+    BranchPredictor::Stats get_branch_stats() const { return bpu.get_stats(); }
+
+    // Hand-over of architectural state from a functional fast-forward.
+    void set_registers(const std::array<uint32_t, Register::MAX_NUMBER>& values) { rf.set_values(values); }
+    std::array<uint32_t, Register::MAX_NUMBER> get_registers() const { return rf.get_values(); }
+    void warm_up(const HierarchyWarmer& warmer) { mmu.warm_up(warmer); }
+    void warm_up(const BranchPredictor& warmer) { bpu.warm_up(warmer); }
     
     void step();
+
+    // Stage that resolves instr, MAX if it is no jump or branch.
+    HazardUnit::Stage get_resolution_stage(const Instruction& instr) const;
+    // Trains the predictor and redirects fetch if instr was mispredicted.
+    void resolve(const Instruction& instr, HazardUnit::Stage stage);
     
     void fetch_stage();
     void decode_stage();
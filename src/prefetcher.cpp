@@ -0,0 +1,95 @@
+#include "prefetcher.h"
+
+#include <cstdlib>
+#include <stdexcept>
+
+const char* const Prefetcher::names[MAX] = { "NONE", "NEXT_LINE", "STRIDE", "STREAM" };
+
+std::unique_ptr<Prefetcher> Prefetcher::create(uint32_t kind, uint32_t line_size, uint32_t degree) {
+    switch (kind) {
+        case NONE:      return nullptr;
+        case NEXT_LINE: return std::make_unique<NextLinePrefetcher>(line_size, degree);
+        case STRIDE:    return std::make_unique<StridePrefetcher>(line_size, degree);
+        case STREAM:    return std::make_unique<StreamPrefetcher>(line_size, degree);
+        default:        throw std::invalid_argument("Unknown prefetcher");
+    }
+}
+
+void NextLinePrefetcher::on_access(const Access& access, std::vector<uint32_t>& candidates) {
+    if (!access.is_miss && !access.is_prefetch_hit)
+        return;
+    const uint32_t line_addr = get_line_addr(access.addr);
+    for (uint32_t i = 1; i <= degree; i++)
+        candidates.push_back(line_addr + i * line_size);
+}
+
+void StridePrefetcher::on_access(const Access& access, std::vector<uint32_t>& candidates) {
+    Entry& entry = table[(access.PC >> 2) % TABLE_SIZE];
+    if (entry.PC != access.PC) {
+        entry = Entry();
+        entry.PC = access.PC;
+        entry.last_addr = access.addr;
+        return;
+    }
+
+    const int32_t stride = static_cast<int32_t>(access.addr - entry.last_addr);
+    entry.last_addr = access.addr;
+    if (stride == 0)
+        return;
+    if (stride == entry.stride) {
+        if (entry.confidence < MAX_CONFIDENCE)
+            entry.confidence++;
+    }
+    else if (entry.confidence > 0)
+        entry.confidence--;
+    else
+        entry.stride = stride;
+
+    if (entry.confidence < MIN_CONFIDENCE)
+        return;
+
+    int32_t step = entry.stride;
+    if (std::abs(step) < static_cast<int32_t>(line_size))
+        step = step > 0 ? line_size : -static_cast<int32_t>(line_size);
+    for (uint32_t i = 1; i <= degree; i++)
+        candidates.push_back(get_line_addr(access.addr + i * step));
+}
+
+void StreamPrefetcher::on_access(const Access& access, std::vector<uint32_t>& candidates) {
+    if (!access.is_miss && !access.is_prefetch_hit)
+        return;
+    now++;
+    const uint32_t line = access.addr / line_size;
+
+    Stream* stream = nullptr;
+    for (auto& candidate : streams) {
+        const int32_t distance = static_cast<int32_t>(line - candidate.last_line);
+        if (candidate.is_valid && distance != 0 && std::abs(distance) <= WINDOW) {
+            stream = &candidate;
+            break;
+        }
+    }
+
+    if (stream == nullptr) {
+        stream = &streams[0];
+        for (auto& candidate : streams)
+            if (!candidate.is_valid || candidate.last_use < stream->last_use)
+                stream = &candidate;
+        *stream = Stream();
+        stream->is_valid = true;
+        stream->last_line = line;
+        stream->last_use = now;
+        return;
+    }
+
+    const int32_t direction = static_cast<int32_t>(line - stream->last_line) > 0 ? 1 : -1;
+    const bool is_confirmed = direction == stream->direction;
+    stream->direction = direction;
+    stream->last_line = line;
+    stream->last_use = now;
+    if (!is_confirmed)
+        return;
+
+    for (uint32_t i = 1; i <= degree; i++)
+        candidates.push_back((line + direction * static_cast<int32_t>(i)) * line_size);
+}
@@ -0,0 +1,108 @@
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#include "consts.h"
+
+// Hardware prefetcher of a cache. It is trained on every demand access and
+// answers with line addresses to fetch ahead; the cache drops the ones it
+// already holds or is fetching. Tables are sized at construction, so
+// training never allocates.
+class Prefetcher {
+public:
+    enum Kind : uint32_t {
+        NONE,
+        NEXT_LINE,
+        STRIDE,
+        STREAM,
+        MAX
+    };
+    static const char* const names[MAX];
+
+    struct Access {
+        uint32_t PC = 0;
+        uint32_t addr = 0;
+        bool is_miss = false;
+        // First demand hit on a line brought in by a prefetch.
+        bool is_prefetch_hit = false;
+    };
+
+    // Returns nullptr for NONE.
+    static std::unique_ptr<Prefetcher> create(uint32_t kind, uint32_t line_size, uint32_t degree);
+
+    virtual ~Prefetcher() = default;
+
+    // Fills candidates with the line addresses to prefetch.
+    virtual void on_access(const Access& access, std::vector<uint32_t>& candidates) = 0;
+
+    uint32_t get_kind() const { return kind; }
+    const char* get_name() const { return names[kind]; }
+
+protected:
+    uint32_t kind;
+    uint32_t line_size;
+    // Lines fetched ahead per trigger.
+    uint32_t degree;
+
+    Prefetcher(uint32_t kind, uint32_t line_size, uint32_t degree) : kind(kind), line_size(line_size), degree(degree) {}
+
+    uint32_t get_line_addr(uint32_t addr) const { return addr - addr % line_size; }
+};
+
+// Tagged next-line: a miss, or the first use of a prefetched line, fetches
+// the lines that follow it. Suited to instruction fetch.
+class NextLinePrefetcher : public Prefetcher {
+public:
+    NextLinePrefetcher(uint32_t line_size, uint32_t degree) : Prefetcher(NEXT_LINE, line_size, degree) {}
+    void on_access(const Access& access, std::vector<uint32_t>& candidates) override;
+};
+
+// Reference prediction table indexed by the PC of the access. Once the
+// same stride is seen twice in a row, the lines that far and further
+// ahead are fetched; strides within a line step whole lines.
+class StridePrefetcher : public Prefetcher {
+private:
+    static const uint32_t TABLE_SIZE = 64;
+    static const uint8_t MAX_CONFIDENCE = 3;
+    static const uint8_t MIN_CONFIDENCE = 2;
+
+    struct Entry {
+        uint32_t PC = NO_VAL32;
+        uint32_t last_addr = 0;
+        int32_t stride = 0;
+        uint8_t confidence = 0;
+    };
+    std::array<Entry, TABLE_SIZE> table;
+
+public:
+    StridePrefetcher(uint32_t line_size, uint32_t degree) : Prefetcher(STRIDE, line_size, degree) {}
+    void on_access(const Access& access, std::vector<uint32_t>& candidates) override;
+};
+
+// Detects ascending or descending streams of missing lines regardless of
+// the PC. A stream is confirmed by a second miss next to its last line,
+// then runs degree lines ahead of the accesses.
+class StreamPrefetcher : public Prefetcher {
+private:
+    static const uint32_t NUM_STREAMS = 8;
+    // Lines around the last one that still belong to a stream.
+    static const int32_t WINDOW = 4;
+
+    struct Stream {
+        bool is_valid = false;
+        uint32_t last_line = 0;
+        int32_t direction = 0;
+        uint64_t last_use = 0;
+    };
+    std::array<Stream, NUM_STREAMS> streams;
+    uint64_t now = 0;
+
+public:
+    StreamPrefetcher(uint32_t line_size, uint32_t degree) : Prefetcher(STREAM, line_size, degree) {}
+    void on_access(const Access& access, std::vector<uint32_t>& candidates) override;
+};
+
+#endif
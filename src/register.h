@@ -2,6 +2,9 @@
 #define REGISTER_H
 
 #include <array>
+#include <cstddef>
+#include <ostream>
+#include <string>
 
 class Register {
 public:
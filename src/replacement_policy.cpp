@@ -0,0 +1,114 @@
+#include "replacement_policy.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+const char* const ReplacementPolicy::names[MAX] = { "FIFO", "LRU", "PLRU", "SRRIP", "BRRIP", "RANDOM" };
+
+std::unique_ptr<ReplacementPolicy> ReplacementPolicy::create(uint32_t kind, uint32_t num_sets, uint32_t num_ways) {
+    switch (kind) {
+        case FIFO:   return std::make_unique<FifoPolicy>(num_sets, num_ways);
+        case LRU:    return std::make_unique<LruPolicy>(num_sets, num_ways);
+        case PLRU:   return std::make_unique<PlruPolicy>(num_sets, num_ways);
+        case SRRIP:  return std::make_unique<RripPolicy>(num_sets, num_ways, false);
+        case BRRIP:  return std::make_unique<RripPolicy>(num_sets, num_ways, true);
+        case RANDOM: return std::make_unique<RandomPolicy>(num_ways);
+        default:     throw std::invalid_argument("Unknown replacement policy");
+    }
+}
+
+FifoPolicy::FifoPolicy(uint32_t num_sets, uint32_t num_ways)
+    : ReplacementPolicy(FIFO, num_ways)
+    , next(num_sets, 0)
+    {}
+
+// Only a fill of the oldest way moves the pointer; invalid ways are filled
+// in order anyway, so this is the same rotation as a queue per set.
+void FifoPolicy::on_fill(uint32_t set, uint32_t way) {
+    if (way == next[set])
+        next[set] = (way + 1) % num_ways;
+}
+
+LruPolicy::LruPolicy(uint32_t num_sets, uint32_t num_ways)
+    : ReplacementPolicy(LRU, num_ways)
+    , stamps(size_t(num_sets) * num_ways, 0)
+    {}
+
+uint32_t LruPolicy::get_victim(uint32_t set) {
+    const uint64_t* set_stamps = &stamps[size_t(set) * num_ways];
+    uint32_t victim = 0;
+    for (uint32_t way = 1; way < num_ways; way++)
+        if (set_stamps[way] < set_stamps[victim])
+            victim = way;
+    return victim;
+}
+
+PlruPolicy::PlruPolicy(uint32_t num_sets, uint32_t num_ways)
+    : ReplacementPolicy(PLRU, num_ways)
+    , bits(size_t(num_sets) * num_ways, 0)
+    {
+        if ((num_ways & (num_ways - 1)) != 0)
+            throw std::invalid_argument("Tree PLRU needs a power-of-two number of ways");
+    }
+
+// Node n has children 2n + 1 and 2n + 2; a set bit means the right half
+// is the less recently used one.
+void PlruPolicy::on_hit(uint32_t set, uint32_t way) {
+    uint8_t* tree = get_tree(set);
+    uint32_t node = 0;
+    for (uint32_t low = 0, size = num_ways; size > 1; size /= 2) {
+        const bool is_right = way >= low + size / 2;
+        tree[node] = !is_right;
+        if (is_right)
+            low += size / 2;
+        node = 2 * node + 1 + is_right;
+    }
+}
+
+uint32_t PlruPolicy::get_victim(uint32_t set) {
+    const uint8_t* tree = get_tree(set);
+    uint32_t node = 0;
+    uint32_t low = 0;
+    for (uint32_t size = num_ways; size > 1; size /= 2) {
+        const bool is_right = tree[node];
+        if (is_right)
+            low += size / 2;
+        node = 2 * node + 1 + is_right;
+    }
+    return low;
+}
+
+RripPolicy::RripPolicy(uint32_t num_sets, uint32_t num_ways, bool is_bimodal)
+    : ReplacementPolicy(is_bimodal ? BRRIP : SRRIP, num_ways)
+    , rrpv(size_t(num_sets) * num_ways, MAX_RRPV)
+    {}
+
+void RripPolicy::on_fill(uint32_t set, uint32_t way) {
+    uint8_t value = MAX_RRPV - 1;
+    if (kind == BRRIP && ++fills % BIMODAL_PERIOD != 0)
+        value = MAX_RRPV;
+    rrpv[size_t(set) * num_ways + way] = value;
+}
+
+// Ages the whole set until some line reaches the distant interval.
+uint32_t RripPolicy::get_victim(uint32_t set) {
+    uint8_t* set_rrpv = &rrpv[size_t(set) * num_ways];
+    uint8_t oldest = 0;
+    for (uint32_t way = 0; way < num_ways; way++)
+        oldest = std::max(oldest, set_rrpv[way]);
+    const uint8_t age = MAX_RRPV - oldest;
+    uint32_t victim = num_ways;
+    for (uint32_t way = 0; way < num_ways; way++) {
+        set_rrpv[way] += age;
+        if (set_rrpv[way] == MAX_RRPV && victim == num_ways)
+            victim = way;
+    }
+    return victim;
+}
+
+uint32_t RandomPolicy::get_victim(uint32_t) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state % num_ways;
+}
@@ -0,0 +1,129 @@
+#ifndef REPLACEMENT_POLICY_H
+#define REPLACEMENT_POLICY_H
+
+#include <memory>
+#include <vector>
+
+#include "consts.h"
+
+// Victim selection for a set-associative cache. Each policy keeps its
+// per-set state in flat arrays sized at construction, so accesses never
+// allocate. The cache fills invalid ways first and only asks for a victim
+// when the set is full.
+class ReplacementPolicy {
+public:
+    enum Kind : uint32_t {
+        FIFO,
+        LRU,
+        PLRU,
+        SRRIP,
+        BRRIP,
+        RANDOM,
+        MAX
+    };
+    static const char* const names[MAX];
+
+    static std::unique_ptr<ReplacementPolicy> create(uint32_t kind, uint32_t num_sets, uint32_t num_ways);
+
+    virtual ~ReplacementPolicy() = default;
+    virtual std::unique_ptr<ReplacementPolicy> clone() const = 0;
+
+    // A hit on a line that was already present.
+    virtual void on_hit(uint32_t set, uint32_t way) = 0;
+    // A new line was placed into the way.
+    virtual void on_fill(uint32_t set, uint32_t way) = 0;
+    virtual uint32_t get_victim(uint32_t set) = 0;
+
+    uint32_t get_kind() const { return kind; }
+    const char* get_name() const { return names[kind]; }
+
+protected:
+    uint32_t kind;
+    uint32_t num_ways;
+
+    ReplacementPolicy(uint32_t kind, uint32_t num_ways) : kind(kind), num_ways(num_ways) {}
+};
+
+// Round robin over the ways, the original policy of the model.
+class FifoPolicy : public ReplacementPolicy {
+private:
+    std::vector<uint32_t> next;
+
+public:
+    FifoPolicy(uint32_t num_sets, uint32_t num_ways);
+    std::unique_ptr<ReplacementPolicy> clone() const override { return std::make_unique<FifoPolicy>(*this); }
+
+    void on_hit(uint32_t, uint32_t) override {}
+    void on_fill(uint32_t set, uint32_t way) override;
+    uint32_t get_victim(uint32_t set) override { return next[set]; }
+};
+
+// True LRU with a last-use stamp per line.
+class LruPolicy : public ReplacementPolicy {
+private:
+    std::vector<uint64_t> stamps;
+    uint64_t now = 0;
+
+public:
+    LruPolicy(uint32_t num_sets, uint32_t num_ways);
+    std::unique_ptr<ReplacementPolicy> clone() const override { return std::make_unique<LruPolicy>(*this); }
+
+    void on_hit(uint32_t set, uint32_t way) override { stamps[size_t(set) * num_ways + way] = ++now; }
+    void on_fill(uint32_t set, uint32_t way) override { on_hit(set, way); }
+    uint32_t get_victim(uint32_t set) override;
+};
+
+// Tree pseudo-LRU: num_ways - 1 bits per set, each pointing to the half
+// of its subtree that was used less recently. Needs power-of-two ways.
+class PlruPolicy : public ReplacementPolicy {
+private:
+    std::vector<uint8_t> bits;
+
+    uint8_t* get_tree(uint32_t set) { return &bits[size_t(set) * num_ways]; }
+
+public:
+    PlruPolicy(uint32_t num_sets, uint32_t num_ways);
+    std::unique_ptr<ReplacementPolicy> clone() const override { return std::make_unique<PlruPolicy>(*this); }
+
+    void on_hit(uint32_t set, uint32_t way) override;
+    void on_fill(uint32_t set, uint32_t way) override { on_hit(set, way); }
+    uint32_t get_victim(uint32_t set) override;
+};
+
+// Re-reference interval prediction with 2-bit counters. SRRIP inserts
+// lines with a long predicted interval, BRRIP with a distant one except
+// for every BIMODAL_PERIOD-th fill, which keeps thrashing working sets
+// from flushing the whole cache.
+class RripPolicy : public ReplacementPolicy {
+private:
+    static constexpr uint8_t MAX_RRPV = 3;
+    static constexpr uint32_t BIMODAL_PERIOD = 32;
+
+    std::vector<uint8_t> rrpv;
+    uint32_t fills = 0;
+
+public:
+    RripPolicy(uint32_t num_sets, uint32_t num_ways, bool is_bimodal);
+    std::unique_ptr<ReplacementPolicy> clone() const override { return std::make_unique<RripPolicy>(*this); }
+
+    void on_hit(uint32_t set, uint32_t way) override { rrpv[size_t(set) * num_ways + way] = 0; }
+    void on_fill(uint32_t set, uint32_t way) override;
+    uint32_t get_victim(uint32_t set) override;
+};
+
+// Uniformly random victim from a fixed-seed xorshift generator, so runs
+// are reproducible.
+class RandomPolicy : public ReplacementPolicy {
+private:
+    uint32_t state = 0x9E3779B9;
+
+public:
+    RandomPolicy(uint32_t num_ways) : ReplacementPolicy(RANDOM, num_ways) {}
+    std::unique_ptr<ReplacementPolicy> clone() const override { return std::make_unique<RandomPolicy>(*this); }
+
+    void on_hit(uint32_t, uint32_t) override {}
+    void on_fill(uint32_t, uint32_t) override {}
+    uint32_t get_victim(uint32_t set) override;
+};
+
+#endif
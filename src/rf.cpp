@@ -55,6 +55,18 @@ void RF::set_stack_pointer(uint32_t value) {
     write(Register::Names::sp, value);
 }
 
+std::array<uint32_t, Register::MAX_NUMBER> RF::get_values() const {
+    std::array<uint32_t, Register::MAX_NUMBER> values;
+    for (uint8_t i = 0; i < Register::MAX_NUMBER; i++)
+        values[i] = register_table[i].value;
+    return values;
+}
+
+void RF::set_values(const std::array<uint32_t, Register::MAX_NUMBER>& values) {
+    for (uint8_t i = 0; i < Register::MAX_NUMBER; i++)
+        write(i, values[i]);
+}
+
 void RF::dump() const {
     if (!IS_DUMP_RF)
         return;
@@ -30,6 +30,9 @@ public:
     void set_stack_pointer(uint32_t value);
     void validate(Register num);
 
+    std::array<uint32_t, Register::MAX_NUMBER> get_values() const;
+    void set_values(const std::array<uint32_t, Register::MAX_NUMBER>& values);
+
     void dump() const;
 };
 
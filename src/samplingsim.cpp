@@ -0,0 +1,134 @@
+#include "samplingsim.h"
+
+#include <cmath>
+#include <err.h>
+
+namespace {
+
+// Two-sided 95% confidence; sample counts are large enough for the normal
+// approximation.
+const double Z_95 = 1.96;
+
+struct Estimate {
+    double mean = 0;
+    double half_width = 0;
+};
+
+template <typename F>
+Estimate estimate(const std::vector<HazardUnit::Stats>& samples, F metric) {
+    Estimate result;
+    const size_t n = samples.size();
+    if (n == 0)
+        return result;
+
+    for (const auto& sample : samples)
+        result.mean += metric(sample);
+    result.mean /= n;
+
+    if (n < 2)
+        return result;
+
+    double variance = 0;
+    for (const auto& sample : samples) {
+        double diff = metric(sample) - result.mean;
+        variance += diff * diff;
+    }
+    variance /= n - 1;
+    result.half_width = Z_95 * std::sqrt(variance / n);
+    return result;
+}
+
+void print_estimate(const char* name, const Estimate& value) {
+    std::cout << name << ": " << value.mean << " +- " << value.half_width
+              << " (" << (value.mean ? 100 * value.half_width / value.mean : 0) << "%)" << std::endl;
+}
+
+}
+
+SamplingSim::SamplingSim(const Memory::Pages& image, uint32_t PC, const Params& params, const Config& config):
+    fsim(image, PC, FuncSim::Engine::THREADED),
+    warmer(config),
+    predictor(config.branch_predictor, config.btb_entries, config.predictor_entries, config.history_length, config.ras_depth),
+    params(params),
+    config(config)
+{
+    if (params.measure == 0 || params.period < uint64_t(params.warm_up) + params.measure)
+        errx(EXIT_FAILURE, "Sampling period must cover warm-up and measurement windows");
+    fsim.set_warmers(&warmer.icache, &warmer.dcache);
+    if (predictor.is_enabled())
+        fsim.set_branch_warmer(&predictor);
+}
+
+HazardUnit::Stats simulate_window(const FuncSim& fsim, const HierarchyWarmer& warmer, const BranchPredictor& predictor,
+                                  const Config& config, uint32_t warm_up, uint32_t measure) {
+    PerfSim psim(fsim.get_memory_pages(), fsim.get_PC(), config);
+    psim.set_trace(false);
+    psim.set_visual(false);
+    psim.set_registers(fsim.get_registers());
+    psim.warm_up(warmer);
+    psim.warm_up(predictor);
+
+    psim.simulate(warm_up);
+    HazardUnit::Stats before = psim.get_stats();
+    psim.simulate(warm_up + measure);
+    HazardUnit::Stats after = psim.get_stats();
+
+    HazardUnit::Stats window;
+    window.cycles = after.cycles - before.cycles;
+    window.instructions = after.instructions - before.instructions;
+    window.data_dependency = after.data_dependency - before.data_dependency;
+    window.memory = after.memory - before.memory;
+    window.mispredict = after.mispredict - before.mispredict;
+    return window;
+}
+
+void SamplingSim::run(uint64_t n) {
+    const uint64_t window = params.warm_up + params.measure;
+    const uint64_t num_samples = n / params.period;
+
+    for (uint64_t i = 0; i < num_samples; i++) {
+        fsim.run(params.period - window);
+        samples.push_back(simulate_window(fsim, warmer, predictor, config, params.warm_up, params.measure));
+        // PerfSim works on a copy, so advance the functional state (and the
+        // warmers) over the window it has just simulated.
+        fsim.run(window);
+    }
+    fsim.run(n - num_samples * params.period);
+
+    print_stats(n);
+}
+
+void SamplingSim::print_stats(uint64_t n) const {
+    uint64_t detailed = samples.size() * (uint64_t(params.warm_up) + params.measure);
+    std::cout << std::dec << "Sampled instructions: " << n << std::endl;
+    std::cout << "Samples: " << samples.size() << std::endl;
+    std::cout << "Detailed instructions: " << detailed
+              << " (" << (n ? 100.0 * detailed / n : 0) << "%)" << std::endl;
+    warmer.print_stats();
+
+    if (samples.empty()) {
+        std::cout << "No samples taken, run longer than one period" << std::endl;
+        return;
+    }
+
+    auto per_instruction = [](uint32_t HazardUnit::Stats::*counter) {
+        return [counter](const HazardUnit::Stats& s) {
+            return static_cast<double>(s.*counter) / s.instructions;
+        };
+    };
+
+    std::cout << "95% confidence intervals:" << std::endl;
+    print_estimate("CPI", estimate(samples, per_instruction(&HazardUnit::Stats::cycles)));
+    print_estimate("IPC", estimate(samples, [](const HazardUnit::Stats& s) {
+        return static_cast<double>(s.instructions) / s.cycles;
+    }));
+    print_estimate("Data dependency stalls per instruction",
+                   estimate(samples, per_instruction(&HazardUnit::Stats::data_dependency)));
+    print_estimate("Memory latency per instruction",
+                   estimate(samples, per_instruction(&HazardUnit::Stats::memory)));
+    print_estimate("Misprediction penalty per instruction",
+                   estimate(samples, per_instruction(&HazardUnit::Stats::mispredict)));
+    // Caches and the predictor are warmed functionally; the rest is not.
+    std::cout << "The intervals cover sampling variance only, not warm-up bias: MSHRs, the store buffer" << std::endl
+              << "and prefetchers start empty in every window and rely on the detailed warm-up" << std::endl;
+}
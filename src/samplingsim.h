@@ -0,0 +1,48 @@
+#ifndef SAMPLINGSIM_H
+#define SAMPLINGSIM_H
+
+#include <vector>
+
+#include "funcsim.h"
+#include "perfsim.h"
+#include "hazard_unit.h"
+#include "cache_warmer.h"
+#include "consts.h"
+#include "config.h"
+
+// Starts PerfSim from the current functional state, warmed caches and the
+// functionally trained branch predictor, runs warm_up detailed instructions
+// and returns the counters of the following measure instructions.
+HazardUnit::Stats simulate_window(const FuncSim& fsim, const HierarchyWarmer& warmer, const BranchPredictor& predictor,
+                                  const Config& config, uint32_t warm_up, uint32_t measure);
+
+// SMARTS-style systematic sampling. Every period the program is
+// fast-forwarded functionally with cache warm-up, then PerfSim runs a short
+// detailed warm-up followed by a measured window. CPI is reported with a
+// confidence interval over all measured windows.
+class SamplingSim {
+public:
+    struct Params {
+        uint64_t period = 100000;
+        uint32_t warm_up = 2000;
+        uint32_t measure = 1000;
+    };
+
+private:
+    FuncSim fsim;
+    HierarchyWarmer warmer;
+    BranchPredictor predictor;
+    Params params;
+    Config config;
+
+    std::vector<HazardUnit::Stats> samples;
+
+    void print_stats(uint64_t n) const;
+
+public:
+    SamplingSim(const Memory::Pages& image, uint32_t PC, const Params& params, const Config& config = Config());
+    void run(uint64_t n);
+    void set_registers(const std::array<uint32_t, Register::MAX_NUMBER>& values) { fsim.set_registers(values); }
+};
+
+#endif
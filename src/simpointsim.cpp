@@ -0,0 +1,186 @@
+#include "simpointsim.h"
+#include "samplingsim.h"
+
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <err.h>
+
+namespace {
+
+// Deterministic value in [-1, 1] for a (block, dimension) pair, so the
+// projection matrix never has to be stored.
+double projection(uint32_t PC, size_t dimension) {
+    uint64_t x = (static_cast<uint64_t>(PC) << 8 | dimension) + 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return static_cast<double>(x >> 11) / (1ull << 52) - 1.0;
+}
+
+template <typename V>
+double distance(const V& a, const V& b) {
+    double result = 0;
+    for (size_t i = 0; i < a.size(); i++)
+        result += (a[i] - b[i]) * (a[i] - b[i]);
+    return result;
+}
+
+}
+
+SimPointSim::SimPointSim(const Memory::Pages& image, uint32_t PC, const Params& params, const Config& config):
+    image(image),
+    start_PC(PC),
+    params(params),
+    config(config)
+{
+    if (params.interval == 0 || params.max_k == 0)
+        errx(EXIT_FAILURE, "SimPoint interval and number of clusters must be positive");
+}
+
+void SimPointSim::run(uint64_t n) {
+    profile(n);
+    cluster();
+    simulate();
+    print_stats();
+}
+
+void SimPointSim::profile(uint64_t n) {
+    FuncSim fsim(image, start_PC, FuncSim::Engine::THREADED);
+    if (start_registers)
+        fsim.set_registers(*start_registers);
+    ThreadedEngine::BlockProfile block_profile;
+    fsim.set_profile(&block_profile);
+
+    for (uint64_t i = 0; i < n / params.interval; i++) {
+        block_profile.clear();
+        fsim.run(params.interval);
+
+        Vector bbv = {};
+        for (const auto& block : block_profile) {
+            double frequency = static_cast<double>(block.second) / params.interval;
+            for (size_t d = 0; d < DIMENSIONS; d++)
+                bbv[d] += frequency * projection(block.first, d);
+        }
+        bbvs.push_back(bbv);
+    }
+}
+
+void SimPointSim::cluster() {
+    const size_t k = std::min<size_t>(params.max_k, bbvs.size());
+    if (k == 0)
+        return;
+
+    // k-means++ seeding with a fixed seed keeps the choice reproducible.
+    std::mt19937 random(1);
+    std::vector<Vector> centroids;
+    centroids.push_back(bbvs[random() % bbvs.size()]);
+    std::vector<double> nearest(bbvs.size(), std::numeric_limits<double>::max());
+    while (centroids.size() < k) {
+        for (size_t i = 0; i < bbvs.size(); i++)
+            nearest[i] = std::min(nearest[i], distance(bbvs[i], centroids.back()));
+        // All remaining vectors coincide with a centroid: fewer phases than k.
+        if (*std::max_element(nearest.begin(), nearest.end()) == 0)
+            break;
+        std::discrete_distribution<size_t> pick(nearest.begin(), nearest.end());
+        centroids.push_back(bbvs[pick(random)]);
+    }
+
+    std::vector<size_t> assignment(bbvs.size(), 0);
+    for (uint32_t iteration = 0; iteration < MAX_ITERATIONS; iteration++) {
+        bool is_changed = iteration == 0;
+        for (size_t i = 0; i < bbvs.size(); i++) {
+            size_t best = 0;
+            for (size_t c = 1; c < centroids.size(); c++)
+                if (distance(bbvs[i], centroids[c]) < distance(bbvs[i], centroids[best]))
+                    best = c;
+            if (assignment[i] != best) {
+                assignment[i] = best;
+                is_changed = true;
+            }
+        }
+        if (!is_changed)
+            break;
+
+        std::vector<Vector> sums(centroids.size(), Vector{});
+        std::vector<size_t> sizes(centroids.size(), 0);
+        for (size_t i = 0; i < bbvs.size(); i++) {
+            for (size_t d = 0; d < DIMENSIONS; d++)
+                sums[assignment[i]][d] += bbvs[i][d];
+            sizes[assignment[i]]++;
+        }
+        for (size_t c = 0; c < centroids.size(); c++)
+            if (sizes[c] != 0)
+                for (size_t d = 0; d < DIMENSIONS; d++)
+                    centroids[c][d] = sums[c][d] / sizes[c];
+    }
+
+    // Representative of a cluster is its member closest to the centroid.
+    for (size_t c = 0; c < centroids.size(); c++) {
+        SimPoint point;
+        size_t size = 0;
+        double best = std::numeric_limits<double>::max();
+        for (size_t i = 0; i < bbvs.size(); i++) {
+            if (assignment[i] != c)
+                continue;
+            size++;
+            double d = distance(bbvs[i], centroids[c]);
+            if (d < best) {
+                best = d;
+                point.interval = i;
+            }
+        }
+        if (size == 0)
+            continue;
+        point.weight = static_cast<double>(size) / bbvs.size();
+        points.push_back(point);
+    }
+    std::sort(points.begin(), points.end(), [](const SimPoint& a, const SimPoint& b) {
+        return a.interval < b.interval;
+    });
+}
+
+// One functional pass restores the state in front of each point in turn,
+// with the caches and the branch predictor warmed along the way.
+void SimPointSim::simulate() {
+    FuncSim fsim(image, start_PC, FuncSim::Engine::THREADED);
+    if (start_registers)
+        fsim.set_registers(*start_registers);
+    HierarchyWarmer warmer(config);
+    fsim.set_warmers(&warmer.icache, &warmer.dcache);
+    BranchPredictor predictor(config.branch_predictor, config.btb_entries, config.predictor_entries,
+                              config.history_length, config.ras_depth);
+    if (predictor.is_enabled())
+        fsim.set_branch_warmer(&predictor);
+
+    uint64_t position = 0;
+    for (auto& point : points) {
+        uint64_t start = point.interval * params.interval;
+        uint32_t warm_up = static_cast<uint32_t>(std::min<uint64_t>(params.warm_up, start - position));
+        fsim.run(start - warm_up - position);
+        point.stats = simulate_window(fsim, warmer, predictor, config, warm_up, params.interval);
+        fsim.run(warm_up + params.interval);
+        position = start + params.interval;
+    }
+}
+
+void SimPointSim::print_stats() const {
+    std::cout << std::dec << "Intervals: " << bbvs.size() << " of " << params.interval << " instructions" << std::endl;
+    if (points.empty()) {
+        std::cout << "No simulation points, run longer than one interval" << std::endl;
+        return;
+    }
+
+    std::cout << "Simulation points:" << std::endl;
+    double CPI = 0;
+    for (const auto& point : points) {
+        double point_CPI = static_cast<double>(point.stats.cycles) / point.stats.instructions;
+        std::cout << "Interval " << point.interval << " weight " << point.weight
+                  << " CPI " << point_CPI << std::endl;
+        CPI += point.weight * point_CPI;
+    }
+    uint64_t detailed = points.size() * params.interval;
+    std::cout << "Detailed instructions: " << detailed
+              << " (" << 100.0 * detailed / (bbvs.size() * params.interval) << "%)" << std::endl;
+    std::cout << "Estimated CPI: " << CPI << std::endl;
+}
@@ -0,0 +1,59 @@
+#ifndef SIMPOINTSIM_H
+#define SIMPOINTSIM_H
+
+#include <array>
+#include <optional>
+#include <vector>
+
+#include "funcsim.h"
+#include "hazard_unit.h"
+#include "cache_warmer.h"
+#include "consts.h"
+#include "config.h"
+
+// SimPoint-style phase analysis. A functional pass collects a basic block
+// vector per fixed instruction interval, the vectors are clustered with
+// k-means and the interval closest to each centroid becomes a simulation
+// point weighted by its cluster size. Only those intervals are simulated in
+// detail and their CPIs are combined into a whole-program estimate.
+class SimPointSim {
+public:
+    struct Params {
+        uint64_t interval = 100000;
+        uint32_t max_k = 8;
+        uint32_t warm_up = 2000;
+    };
+
+    struct SimPoint {
+        uint64_t interval = 0;
+        double weight = 0;
+        HazardUnit::Stats stats;
+    };
+
+private:
+    // Basic block vectors are randomly projected to this many dimensions.
+    static const size_t DIMENSIONS = 15;
+    static const uint32_t MAX_ITERATIONS = 100;
+    using Vector = std::array<double, DIMENSIONS>;
+
+    Memory::Pages image;
+    uint32_t start_PC;
+    std::optional<std::array<uint32_t, Register::MAX_NUMBER>> start_registers;
+    Params params;
+    Config config;
+
+    std::vector<Vector> bbvs;
+    std::vector<SimPoint> points;
+
+    void profile(uint64_t n);
+    void cluster();
+    void simulate();
+    void print_stats() const;
+
+public:
+    SimPointSim(const Memory::Pages& image, uint32_t PC, const Params& params, const Config& config = Config());
+    void run(uint64_t n);
+    void set_registers(const std::array<uint32_t, Register::MAX_NUMBER>& values) { start_registers = values; }
+};
+
+#endif
@@ -0,0 +1,81 @@
+#include "stack_distance.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <err.h>
+
+StackDistance::StackDistance(uint32_t line_size_in_bytes, uint32_t max_sets, uint32_t max_ways):
+    line_size_in_bytes(line_size_in_bytes),
+    max_ways(max_ways)
+{
+    if (max_sets == 0 || (max_sets & (max_sets - 1)) != 0 || max_ways == 0)
+        errx(EXIT_FAILURE, "Stack distance needs a power-of-two set count and positive ways");
+
+    for (uint32_t num_sets = 1; num_sets <= max_sets; num_sets *= 2) {
+        Level level;
+        level.stacks.resize(num_sets);
+        level.histogram.resize(max_ways, 0);
+        levels.push_back(std::move(level));
+    }
+}
+
+// Stacks are cut at max_ways: anything deeper misses in every tracked
+// associativity anyway.
+void StackDistance::access(uint32_t addr, bool is_write) {
+    const uint32_t tag = addr / line_size_in_bytes;
+    accesses++;
+    writes += is_write;
+
+    for (auto& level : levels) {
+        auto& stack = level.stacks[tag & (level.stacks.size() - 1)];
+        auto it = std::find(stack.begin(), stack.end(), tag);
+        if (it != stack.end()) {
+            level.histogram[it - stack.begin()]++;
+            std::rotate(stack.begin(), it, it + 1);
+            continue;
+        }
+        if (stack.size() < max_ways)
+            stack.push_back(tag);
+        else
+            stack.back() = tag;
+        std::rotate(stack.begin(), stack.end() - 1, stack.end());
+    }
+}
+
+void StackDistance::repeat(uint32_t n) {
+    accesses += n;
+    for (auto& level : levels)
+        level.histogram[0] += n;
+}
+
+double StackDistance::get_miss_ratio(uint32_t num_sets, uint32_t num_ways) const {
+    if (accesses == 0)
+        return 0;
+    size_t index = 0;
+    while ((1u << index) < num_sets)
+        index++;
+    const auto& histogram = levels.at(index).histogram;
+    uint64_t hits = 0;
+    for (uint32_t d = 0; d < std::min(num_ways, max_ways); d++)
+        hits += histogram[d];
+    return static_cast<double>(accesses - hits) / accesses;
+}
+
+void StackDistance::print_stats(const char* name) const {
+    std::cout << std::dec << name << " accesses: " << accesses << ", writes: " << writes
+              << ", line size: " << line_size_in_bytes << std::endl;
+    std::cout << name << " LRU miss ratio, rows are sets, columns are ways:" << std::endl;
+
+    std::cout << std::setw(8) << "Sets";
+    for (uint32_t ways = 1; ways <= max_ways; ways++)
+        std::cout << std::setw(8) << ways;
+    std::cout << std::endl;
+
+    for (size_t i = 0; i < levels.size(); i++) {
+        std::cout << std::setw(8) << (1u << i) << std::fixed << std::setprecision(4);
+        for (uint32_t ways = 1; ways <= max_ways; ways++)
+            std::cout << std::setw(8) << get_miss_ratio(1u << i, ways);
+        std::cout << std::defaultfloat << std::endl;
+    }
+}
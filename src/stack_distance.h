@@ -0,0 +1,38 @@
+#ifndef STACK_DISTANCE_H
+#define STACK_DISTANCE_H
+
+#include <vector>
+
+#include "cache_model.h"
+
+// Mattson stack-distance profile of an access stream. One LRU stack per set
+// is kept for every power-of-two set count up to max_sets, and each access
+// records its reuse distance, so a single pass yields the miss ratio of
+// every LRU cache with that line size, up to max_sets x max_ways.
+class StackDistance : public CacheModel {
+private:
+    struct Level {
+        std::vector<std::vector<uint32_t>> stacks;
+        // histogram[d]: accesses found at depth d of their set's stack.
+        std::vector<uint64_t> histogram;
+    };
+
+    uint32_t line_size_in_bytes;
+    uint32_t max_ways;
+    std::vector<Level> levels;
+
+    uint64_t accesses = 0;
+    uint64_t writes = 0;
+
+public:
+    StackDistance(uint32_t line_size_in_bytes, uint32_t max_sets, uint32_t max_ways);
+
+    void access(uint32_t addr, bool is_write) override;
+    void repeat(uint32_t n) override;
+    uint32_t get_line_size() const override { return line_size_in_bytes; }
+
+    double get_miss_ratio(uint32_t num_sets, uint32_t num_ways) const;
+    void print_stats(const char* name) const;
+};
+
+#endif
@@ -0,0 +1,59 @@
+#include "store_buffer.h"
+
+#include <iostream>
+
+void StoreBuffer::push(uint32_t addr, uint32_t value, uint32_t num_bytes, uint32_t PC) {
+    entries.push_back({addr, value, num_bytes, PC});
+    stats.stores++;
+}
+
+StoreBuffer::Forward StoreBuffer::forward(uint32_t addr, uint32_t num_bytes, uint32_t& value) {
+    for (auto entry = entries.rbegin(); entry != entries.rend(); ++entry) {
+        if (addr + num_bytes <= entry->addr || entry->addr + entry->num_bytes <= addr)
+            continue;
+        if (addr < entry->addr || addr + num_bytes > entry->addr + entry->num_bytes)
+            return Forward::OVERLAP;
+        value = entry->value >> (8 * (addr - entry->addr));
+        if (num_bytes < 4)
+            value &= (1u << (8 * num_bytes)) - 1;
+        stats.forwarded_loads++;
+        return Forward::HIT;
+    }
+    return Forward::NONE;
+}
+
+void StoreBuffer::complete_piece() {
+    is_writing = false;
+    pieces_done++;
+    if (pieces_done * 2 >= entries.front().num_bytes) {
+        pieces_done = 0;
+        entries.pop_front();
+    }
+}
+
+void StoreBuffer::retire() {
+    if (is_writing && mmu.memory_request_status().is_ready)
+        complete_piece();
+}
+
+void StoreBuffer::drain() {
+    if (is_writing || entries.empty() || mmu.is_dcache_busy())
+        return;
+
+    const Entry& entry = entries.front();
+    const size_t num_bytes = (entry.num_bytes == 1) ? 1 : 2;
+    mmu.process_store(entry.value, entry.addr + pieces_done * 2, num_bytes, pieces_done == 0, entry.PC);
+    is_writing = true;
+
+    if (mmu.memory_request_status().is_ready)
+        complete_piece();
+}
+
+void StoreBuffer::print_stats() const {
+    if (!is_enabled())
+        return;
+    std::cout << std::dec << "Store buffer: " << depth << " entries, stores: " << stats.stores
+              << ", forwarded loads: " << stats.forwarded_loads
+              << ", full stall cycles: " << stats.full_stall_cycles
+              << ", overlap stall cycles: " << stats.overlap_stall_cycles << std::endl;
+}
@@ -0,0 +1,70 @@
+#ifndef STORE_BUFFER_H
+#define STORE_BUFFER_H
+
+#include <deque>
+
+#include "mmu.h"
+
+// Stores leave the memory stage into this buffer and are written to the
+// dcache in program order, in cycles the memory stage leaves the dcache
+// free. A load covered by a buffered store takes its value from the
+// youngest such store; a load that only partly overlaps one waits until
+// it has been written.
+class StoreBuffer {
+public:
+    struct Stats {
+        uint64_t stores = 0;
+        uint64_t full_stall_cycles = 0;
+        uint64_t forwarded_loads = 0;
+        uint64_t overlap_stall_cycles = 0;
+    };
+
+    enum class Forward {
+        NONE,
+        HIT,
+        OVERLAP
+    };
+
+    StoreBuffer(MMU& mmu, uint32_t depth) : mmu(mmu), depth(depth) {}
+
+    // A depth of 0 turns the buffer off: stores wait for the dcache.
+    bool is_enabled() const { return depth != 0; }
+    bool is_full() const { return entries.size() == depth; }
+    bool is_empty() const { return entries.empty(); }
+
+    void push(uint32_t addr, uint32_t value, uint32_t num_bytes, uint32_t PC);
+    Forward forward(uint32_t addr, uint32_t num_bytes, uint32_t& value);
+    void count_full_stall() { stats.full_stall_cycles++; }
+    void count_overlap_stall() { stats.overlap_stall_cycles++; }
+
+    // Completes the write the dcache finished; called before the stages.
+    void retire();
+    // Starts the next write; called when the memory stage has not used
+    // the dcache this cycle.
+    void drain();
+
+    Stats get_stats() const { return stats; }
+    void print_stats() const;
+
+private:
+    struct Entry {
+        uint32_t addr = 0;
+        uint32_t value = 0;
+        uint32_t num_bytes = 0;
+        uint32_t PC = 0;
+    };
+
+    MMU& mmu;
+    uint32_t depth;
+    std::deque<Entry> entries;
+    Stats stats;
+
+    // Stores reach the dcache in the 1- or 2-byte pieces the memory stage
+    // uses; the oldest entry stays until its last piece is written.
+    bool is_writing = false;
+    uint32_t pieces_done = 0;
+
+    void complete_piece();
+};
+
+#endif
@@ -0,0 +1,388 @@
+#include "threaded_engine.h"
+#include "jit_x86.h"
+
+#include <mutex>
+
+using OpCode = ThreadedEngine::OpCode;
+
+struct OpCodeItem {
+    Instruction::Executor function;
+    OpCode code;
+};
+
+static const OpCodeItem op_codes[] = {
+    { &Instruction::execute_lui,   OpCode::LUI },
+    { &Instruction::execute_auipc, OpCode::AUIPC },
+    { &Instruction::execute_jal,   OpCode::JAL },
+    { &Instruction::execute_jalr,  OpCode::JALR },
+    { &Instruction::execute_beq,   OpCode::BEQ },
+    { &Instruction::execute_bne,   OpCode::BNE },
+    { &Instruction::execute_blt,   OpCode::BLT },
+    { &Instruction::execute_bge,   OpCode::BGE },
+    { &Instruction::execute_bltu,  OpCode::BLTU },
+    { &Instruction::execute_bgeu,  OpCode::BGEU },
+    { &Instruction::execute_lb,    OpCode::LB },
+    { &Instruction::execute_lh,    OpCode::LH },
+    { &Instruction::execute_lw,    OpCode::LW },
+    { &Instruction::execute_lbu,   OpCode::LBU },
+    { &Instruction::execute_lhu,   OpCode::LHU },
+    { &Instruction::execute_sb,    OpCode::SB },
+    { &Instruction::execute_sh,    OpCode::SH },
+    { &Instruction::execute_sw,    OpCode::SW },
+    { &Instruction::execute_addi,  OpCode::ADDI },
+    { &Instruction::execute_slti,  OpCode::SLTI },
+    { &Instruction::execute_sltiu, OpCode::SLTIU },
+    { &Instruction::execute_xori,  OpCode::XORI },
+    { &Instruction::execute_ori,   OpCode::ORI },
+    { &Instruction::execute_andi,  OpCode::ANDI },
+    { &Instruction::execute_slli,  OpCode::SLLI },
+    { &Instruction::execute_srai,  OpCode::SRAI },
+    { &Instruction::execute_srli,  OpCode::SRLI },
+    { &Instruction::execute_add,   OpCode::ADD },
+    { &Instruction::execute_sub,   OpCode::SUB },
+    { &Instruction::execute_sll,   OpCode::SLL },
+    { &Instruction::execute_slt,   OpCode::SLT },
+    { &Instruction::execute_sltu,  OpCode::SLTU },
+    { &Instruction::execute_xor,   OpCode::XOR },
+    { &Instruction::execute_or,    OpCode::OR },
+    { &Instruction::execute_and,   OpCode::AND },
+    { &Instruction::execute_sra,   OpCode::SRA },
+    { &Instruction::execute_srl,   OpCode::SRL },
+};
+
+static const void* const* handlers = nullptr;
+static std::once_flag handlers_once;
+
+ThreadedEngine::ThreadedEngine(Memory& memory, bool is_jit) :
+    memory(memory),
+    code_pages(1u << (32 - PAGE_BITS), false)
+{
+    std::call_once(handlers_once, [this] {
+        uint32_t PC = NO_VAL32;
+        bool is_code_modified = false;
+        execute(nullptr, PC, is_code_modified);
+    });
+
+    if (is_jit) {
+        jit = std::make_unique<X86Jit>(PAGE_BITS);
+        jit->context.memory = &memory;
+        jit->context.code_pages = &code_pages;
+    }
+}
+
+ThreadedEngine::~ThreadedEngine() = default;
+
+ThreadedEngine::Op ThreadedEngine::decode_op(uint32_t PC) const {
+    Instruction instr(memory.read<4>(PC), PC);
+
+    Op op;
+    op.PC = PC;
+    op.rs1 = static_cast<uint8_t>(instr.get_rs1().id());
+    op.rs2 = static_cast<uint8_t>(instr.get_rs2().id());
+    op.rd = static_cast<uint8_t>(instr.get_rd().id());
+    if (op.rd == Register::zero())
+        op.rd = SINK_REGISTER;
+    op.imm = instr.get_imm_v();
+
+    for (const auto& item : op_codes) {
+        if (item.function == instr.function) {
+            op.code = item.code;
+            op.handler = handlers[static_cast<size_t>(item.code)];
+            return op;
+        }
+    }
+    throw std::invalid_argument("No entry found for given instruction");
+}
+
+ThreadedEngine::Block* ThreadedEngine::build_block(uint32_t PC) {
+    auto block = std::make_unique<Block>();
+    block->PC = PC;
+
+    uint32_t op_PC = PC;
+    while (block->ops.size() < MAX_BLOCK_SIZE) {
+        Op op;
+        if (block->ops.empty()) {
+            // Let a bad first instruction fail the same way FuncSim does.
+            op = decode_op(op_PC);
+        } else {
+            try {
+                op = decode_op(op_PC);
+            } catch (const std::invalid_argument&) {
+                break;
+            }
+        }
+        code_pages[op_PC >> PAGE_BITS] = true;
+        block->ops.push_back(op);
+        op_PC += 4;
+
+        if (op.code == OpCode::JAL || op.code == OpCode::JALR ||
+            (op.code >= OpCode::BEQ && op.code <= OpCode::BGEU))
+            break;
+    }
+
+    block->num_instructions = block->ops.size();
+
+    Op end;
+    end.PC = op_PC;
+    end.handler = handlers[static_cast<size_t>(OpCode::BLOCK_END)];
+    block->ops.push_back(end);
+
+    blocks_built++;
+    auto& slot = blocks[PC];
+    slot = std::move(block);
+    return slot.get();
+}
+
+ThreadedEngine::Block* ThreadedEngine::get_block(uint32_t PC) {
+    auto it = blocks.find(PC);
+    if (it != blocks.end())
+        return it->second.get();
+    return build_block(PC);
+}
+
+void ThreadedEngine::flush() {
+    blocks.clear();
+    std::fill(code_pages.begin(), code_pages.end(), false);
+    if (jit != nullptr)
+        jit->reset();
+    flushes++;
+}
+
+size_t ThreadedEngine::execute(const Op* ops, uint32_t& PC, bool& is_code_modified) {
+    static const void* const table[] = {
+        &&do_lui, &&do_auipc, &&do_jal, &&do_jalr,
+        &&do_beq, &&do_bne, &&do_blt, &&do_bge, &&do_bltu, &&do_bgeu,
+        &&do_lb, &&do_lh, &&do_lw, &&do_lbu, &&do_lhu,
+        &&do_sb, &&do_sh, &&do_sw,
+        &&do_addi, &&do_slti, &&do_sltiu, &&do_xori, &&do_ori, &&do_andi, &&do_slli, &&do_srai, &&do_srli,
+        &&do_add, &&do_sub, &&do_sll, &&do_slt, &&do_sltu, &&do_xor, &&do_or, &&do_and, &&do_sra, &&do_srl,
+        &&do_block_end
+    };
+    static_assert(sizeof(table) / sizeof(table[0]) == static_cast<size_t>(OpCode::MAX), "Handler table mismatch");
+
+    if (ops == nullptr) {
+        handlers = table;
+        return 0;
+    }
+
+    auto& r = regs;
+    const Op* op = ops;
+
+#define DISPATCH() goto *op->handler
+#define NEXT() do { ++op; DISPATCH(); } while (0)
+#define BRANCH(cond) do { PC = (cond) ? op->PC + op->imm : op->PC + 4; return op - ops + 1; } while (0)
+#define LOAD(type, size) do {                                                   \
+        uint32_t addr = r[op->rs1] + op->imm;                                   \
+        if (dcache_warmer != nullptr) {                                         \
+            if (icache_warmer != nullptr)                                       \
+                warm_fetches(op + 1);                                           \
+            dcache_warmer->access(addr, false);                                 \
+        }                                                                       \
+        r[op->rd] = static_cast<uint32_t>(static_cast<type>(memory.read<size>(addr))); \
+        NEXT();                                                                 \
+    } while (0)
+#define STORE(size) do {                                                        \
+        uint32_t addr = r[op->rs1] + op->imm;                                   \
+        if (dcache_warmer != nullptr) {                                         \
+            if (icache_warmer != nullptr)                                       \
+                warm_fetches(op + 1);                                           \
+            dcache_warmer->access(addr, true);                                  \
+        }                                                                       \
+        memory.write<size>(r[op->rs2], addr);                                   \
+        if (is_code_page(addr) || is_code_page(addr + size - 1)) {              \
+            is_code_modified = true;                                            \
+            PC = op->PC + 4;                                                    \
+            return op - ops + 1;                                                \
+        }                                                                       \
+        NEXT();                                                                 \
+    } while (0)
+
+    DISPATCH();
+
+do_lui:   r[op->rd] = op->imm; NEXT();
+do_auipc: r[op->rd] = op->PC + op->imm; NEXT();
+do_jal:
+    r[op->rd] = op->PC + 4;
+    PC = op->PC + op->imm;
+    return op - ops + 1;
+do_jalr: {
+    uint32_t target = (op->imm + r[op->rs1]) & ~1;
+    r[op->rd] = op->PC + 4;
+    PC = target;
+    return op - ops + 1;
+}
+do_beq:  BRANCH(r[op->rs1] == r[op->rs2]);
+do_bne:  BRANCH(r[op->rs1] != r[op->rs2]);
+do_blt:  BRANCH(static_cast<int32_t>(r[op->rs1]) < static_cast<int32_t>(r[op->rs2]));
+do_bge:  BRANCH(static_cast<int32_t>(r[op->rs1]) >= static_cast<int32_t>(r[op->rs2]));
+do_bltu: BRANCH(r[op->rs1] < r[op->rs2]);
+do_bgeu: BRANCH(r[op->rs1] >= r[op->rs2]);
+do_lb:  LOAD(int8_t, 1);
+do_lh:  LOAD(int16_t, 2);
+do_lw:  LOAD(uint32_t, 4);
+do_lbu: LOAD(uint32_t, 1);
+do_lhu: LOAD(uint32_t, 2);
+do_sb: STORE(1);
+do_sh: STORE(2);
+do_sw: STORE(4);
+do_addi:  r[op->rd] = r[op->rs1] + op->imm; NEXT();
+do_slti:  r[op->rd] = static_cast<uint32_t>(static_cast<int32_t>(r[op->rs1]) < op->imm); NEXT();
+do_sltiu: r[op->rd] = static_cast<uint32_t>(r[op->rs1] < static_cast<uint32_t>(op->imm)); NEXT();
+do_xori:  r[op->rd] = r[op->rs1] ^ op->imm; NEXT();
+do_ori:   r[op->rd] = r[op->rs1] | op->imm; NEXT();
+do_andi:  r[op->rd] = r[op->rs1] & op->imm; NEXT();
+do_slli:  r[op->rd] = r[op->rs1] << (op->imm & 0x1f); NEXT();
+do_srai:  r[op->rd] = static_cast<uint32_t>(static_cast<int32_t>(r[op->rs1]) >> (op->imm & 0x1f)); NEXT();
+do_srli:  r[op->rd] = r[op->rs1] >> (op->imm & 0x1f); NEXT();
+do_add:  r[op->rd] = r[op->rs1] + r[op->rs2]; NEXT();
+do_sub:  r[op->rd] = r[op->rs1] - r[op->rs2]; NEXT();
+do_sll:  r[op->rd] = r[op->rs1] << (r[op->rs2] & 0x1f); NEXT();
+do_slt:  r[op->rd] = static_cast<uint32_t>(static_cast<int32_t>(r[op->rs1]) < static_cast<int32_t>(r[op->rs2])); NEXT();
+do_sltu: r[op->rd] = static_cast<uint32_t>(r[op->rs1] < r[op->rs2]); NEXT();
+do_xor:  r[op->rd] = r[op->rs1] ^ r[op->rs2]; NEXT();
+do_or:   r[op->rd] = r[op->rs1] | r[op->rs2]; NEXT();
+do_and:  r[op->rd] = r[op->rs1] & r[op->rs2]; NEXT();
+do_sra:  r[op->rd] = static_cast<uint32_t>(static_cast<int32_t>(r[op->rs1]) >> (r[op->rs2] & 0x1f)); NEXT();
+do_srl:  r[op->rd] = r[op->rs1] >> (r[op->rs2] & 0x1f); NEXT();
+do_block_end:
+    PC = op->PC;
+    return op - ops;
+
+#undef STORE
+#undef LOAD
+#undef BRANCH
+#undef NEXT
+#undef DISPATCH
+}
+
+uint32_t ThreadedEngine::run(Registers& registers, uint32_t PC, uint64_t n) {
+    std::copy(registers.begin(), registers.end(), regs.begin());
+
+    std::vector<Op> tail;
+    Block* prev = nullptr;
+    uint64_t executed = 0;
+
+    while (executed < n) {
+        Block* block = nullptr;
+        if (prev != nullptr) {
+            for (size_t i = 0; i < 2; ++i)
+                if (prev->succ_PC[i] == PC)
+                    block = prev->succ[i];
+        }
+
+        if (block == nullptr) {
+            block = get_block(PC);
+            if (prev != nullptr) {
+                prev->succ_PC[prev->succ_victim] = PC;
+                prev->succ[prev->succ_victim] = block;
+                prev->succ_victim ^= 1;
+            }
+        }
+
+        if (block->native != nullptr && icache_warmer == nullptr && dcache_warmer == nullptr &&
+            branch_warmer == nullptr && profile == nullptr && block->num_instructions <= n - executed) {
+            // Translated code chains through hot blocks on its own and
+            // returns once the budget runs out or it hits an unlinked exit.
+            auto& context = jit->context;
+            context.regs = regs.data();
+            context.budget = n - executed;
+            context.is_code_modified = false;
+            PC = block->native(&context);
+            executed += (n - executed) - context.budget;
+            native_runs++;
+
+            prev = nullptr;
+            if (context.is_code_modified)
+                flush();
+            continue;
+        }
+
+        blocks_executed++;
+        bool is_code_modified = false;
+        size_t retired = 0;
+
+        if (block->num_instructions <= n - executed) {
+            unfetched = block->ops.data();
+            retired = execute(block->ops.data(), PC, is_code_modified);
+            if (icache_warmer != nullptr)
+                warm_fetches(block->ops.data() + retired);
+            if (branch_warmer != nullptr && retired == block->num_instructions)
+                warm_branch(*block, PC);
+        } else {
+            // Not enough budget left for the whole block: run a cut-down copy.
+            size_t left = n - executed;
+            tail.assign(block->ops.begin(), block->ops.begin() + left);
+            Op end;
+            end.PC = block->ops[left].PC;
+            end.handler = handlers[static_cast<size_t>(OpCode::BLOCK_END)];
+            tail.push_back(end);
+            unfetched = tail.data();
+            retired = execute(tail.data(), PC, is_code_modified);
+            if (icache_warmer != nullptr)
+                warm_fetches(tail.data() + retired);
+        }
+
+        executed += retired;
+        if (profile != nullptr)
+            (*profile)[block->PC] += retired;
+
+        if (is_code_modified) {
+            flush();
+            prev = nullptr;
+            continue;
+        }
+
+        if (jit != nullptr && block->native == nullptr && ++block->exec_count == JIT_THRESHOLD)
+            block->native = jit->translate(block->PC, block->ops, block->num_instructions);
+
+        prev = block;
+    }
+
+    std::copy(regs.begin(), regs.begin() + Register::MAX_NUMBER, registers.begin());
+    return PC;
+}
+
+// Ops of a block are sequential and a repeated access to the same line is
+// a hit that does not change the model state, so runs within a line are
+// reported as a count.
+void ThreadedEngine::warm_fetches(const Op* end) {
+    const uint32_t line_size = icache_warmer->get_line_size();
+    uint32_t last_line = NO_VAL32;
+    uint32_t repeats = 0;
+    for (const Op* op = unfetched; op < end; ++op) {
+        uint32_t line = op->PC / line_size;
+        if (line == last_line) {
+            repeats++;
+            continue;
+        }
+        if (repeats != 0)
+            icache_warmer->repeat(repeats);
+        repeats = 0;
+        icache_warmer->access(op->PC, false);
+        last_line = line;
+    }
+    if (repeats != 0)
+        icache_warmer->repeat(repeats);
+    unfetched = end;
+}
+
+// Blocks also end at MAX_BLOCK_SIZE, so the last op need not be a jump or
+// a branch.
+void ThreadedEngine::warm_branch(const Block& block, uint32_t new_PC) {
+    const Op& last = block.ops[block.num_instructions - 1];
+    if (last.code < OpCode::JAL || last.code > OpCode::BGEU)
+        return;
+    Instruction instr(memory.read<4>(last.PC), last.PC);
+    instr.replay(new_PC, 0);
+    branch_warmer->train(instr);
+}
+
+void ThreadedEngine::print_stats() const {
+    std::cout << std::dec << "Threaded blocks built: " << blocks_built << std::endl;
+    std::cout << "Threaded blocks executed: " << blocks_executed << std::endl;
+    std::cout << "Threaded block cache flushes: " << flushes << std::endl;
+    if (jit != nullptr) {
+        std::cout << "JIT native runs: " << native_runs << std::endl;
+        jit->print_stats();
+    }
+}
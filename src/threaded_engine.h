@@ -0,0 +1,130 @@
+#ifndef THREADED_ENGINE_H
+#define THREADED_ENGINE_H
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include "instruction.h"
+#include "memory.h"
+#include "register.h"
+#include "consts.h"
+#include "cache_model.h"
+#include "branch_predictor.h"
+
+class X86Jit;
+struct JitContext;
+
+// Functional engine that splits the program into basic blocks (ending at
+// JUMP/BRANCH), pre-decodes each block into an op array and runs it with
+// direct-threaded dispatch on a flat register array. Optionally hot blocks
+// are handed to X86Jit and run natively.
+class ThreadedEngine {
+public:
+    using Registers = std::array<uint32_t, Register::MAX_NUMBER>;
+    // Retired instructions per basic block start PC.
+    using BlockProfile = std::unordered_map<uint32_t, uint64_t>;
+
+    enum class OpCode : uint8_t {
+        LUI, AUIPC, JAL, JALR,
+        BEQ, BNE, BLT, BGE, BLTU, BGEU,
+        LB, LH, LW, LBU, LHU,
+        SB, SH, SW,
+        ADDI, SLTI, SLTIU, XORI, ORI, ANDI, SLLI, SRAI, SRLI,
+        ADD, SUB, SLL, SLT, SLTU, XOR, OR, AND, SRA, SRL,
+        BLOCK_END,
+        MAX
+    };
+
+    // Writes to x0 are redirected to this slot so handlers never test rd.
+    static const uint8_t SINK_REGISTER = Register::MAX_NUMBER;
+
+    struct Op {
+        const void* handler = nullptr;
+        OpCode code = OpCode::BLOCK_END;
+        uint8_t rd = SINK_REGISTER;
+        uint8_t rs1 = 0;
+        uint8_t rs2 = 0;
+        int32_t imm = 0;
+        uint32_t PC = NO_VAL32;
+    };
+
+private:
+    static constexpr size_t MAX_BLOCK_SIZE = 64;
+    static constexpr uint32_t PAGE_BITS = 12;
+    static constexpr uint32_t JIT_THRESHOLD = 16;
+
+    struct Block {
+        uint32_t PC = NO_VAL32;
+        size_t num_instructions = 0;
+        std::vector<Op> ops;
+
+        // Last two successors seen, to skip the block map on loops.
+        uint32_t succ_PC[2] = {NO_VAL32, NO_VAL32};
+        Block* succ[2] = {nullptr, nullptr};
+        size_t succ_victim = 0;
+
+        uint32_t exec_count = 0;
+        uint32_t (*native)(JitContext*) = nullptr;
+    };
+
+    Memory& memory;
+
+    std::array<uint32_t, Register::MAX_NUMBER + 1> regs = {};
+    std::unordered_map<uint32_t, std::unique_ptr<Block>> blocks;
+    std::vector<bool> code_pages;
+
+    // Hot blocks are translated to host code when the JIT is enabled.
+    std::unique_ptr<X86Jit> jit;
+
+    // Functional cache warm-up; translated code is not used while set.
+    CacheModel* icache_warmer = nullptr;
+    CacheModel* dcache_warmer = nullptr;
+    // First op of the running block whose fetch the icache warmer has not
+    // seen yet. Loads and stores catch up before their data access, so the
+    // warmers get the interpreter's order.
+    const Op* unfetched = nullptr;
+    void warm_fetches(const Op* end);
+    // Trained on the jump or branch ending each block.
+    BranchPredictor* branch_warmer = nullptr;
+    void warm_branch(const Block& block, uint32_t new_PC);
+
+    // Basic block profiling; translated code is not used while set.
+    BlockProfile* profile = nullptr;
+
+    uint64_t blocks_built = 0;
+    uint64_t blocks_executed = 0;
+    uint64_t flushes = 0;
+    uint64_t native_runs = 0;
+
+    Block* get_block(uint32_t PC);
+    Block* build_block(uint32_t PC);
+    Op decode_op(uint32_t PC) const;
+
+    bool is_code_page(uint32_t addr) const { return code_pages[addr >> PAGE_BITS]; }
+    void flush();
+
+    // Executes the ops of one block, returns the number of retired
+    // instructions and updates PC.
+    size_t execute(const Op* ops, uint32_t& PC, bool& is_code_modified);
+
+public:
+    ThreadedEngine(Memory& memory, bool is_jit = false);
+    ~ThreadedEngine();
+
+    // Runs n instructions starting at PC and returns the new PC.
+    uint32_t run(Registers& registers, uint32_t PC, uint64_t n);
+
+    void set_warmers(CacheModel* icache, CacheModel* dcache) {
+        icache_warmer = icache;
+        dcache_warmer = dcache;
+    }
+    void set_branch_warmer(BranchPredictor* predictor) { branch_warmer = predictor; }
+
+    void set_profile(BlockProfile* value) { profile = value; }
+
+    void print_stats() const;
+};
+
+#endif
@@ -0,0 +1,230 @@
+#include "trace.h"
+
+#include <cstring>
+#include <iostream>
+#include <err.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace trace {
+
+static const char MAGIC[8] = {'P', 'S', 'I', 'M', 'T', 'R', 'C', '2'};
+static const size_t CHUNK_SIZE = 1 << 16;
+// flags + PC varint + raw + address varint + target varint + value varint
+static const size_t MAX_RECORD_SIZE = 1 + 5 + 4 + 5 + 5 + 5;
+
+enum Flags : uint8_t {
+    PC_JUMP  = 1 << 0,
+    RAW      = 1 << 1,
+    MEMORY   = 1 << 2,
+    TAKEN    = 1 << 3,
+    RD_VALUE = 1 << 4,
+};
+
+static uint32_t get_rd(uint32_t raw_bytes) {
+    return (raw_bytes >> 7) & 0x1f;
+}
+
+static uint32_t zigzag(uint32_t delta) {
+    return (delta << 1) ^ static_cast<uint32_t>(static_cast<int32_t>(delta) >> 31);
+}
+
+static uint32_t unzigzag(uint32_t value) {
+    return (value >> 1) ^ (0u - (value & 1));
+}
+
+Writer::Writer(const char* file_name) {
+    fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        err(EXIT_FAILURE, "Can't open trace file");
+    buffer.reserve(CHUNK_SIZE + MAX_RECORD_SIZE);
+    buffer.insert(buffer.end(), MAGIC, MAGIC + sizeof(MAGIC));
+}
+
+Writer::~Writer() {
+    close();
+}
+
+void Writer::flush() {
+    const uint8_t* data = buffer.data();
+    size_t size = buffer.size();
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0)
+            err(EXIT_FAILURE, "Can't write trace file");
+        data += written;
+        size -= written;
+    }
+    bytes += buffer.size();
+    buffer.clear();
+}
+
+void Writer::close() {
+    if (fd < 0)
+        return;
+    flush();
+    ::close(fd);
+    fd = -1;
+}
+
+void Writer::put_varint(uint32_t value) {
+    while (value >= 0x80) {
+        buffer.push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    buffer.push_back(static_cast<uint8_t>(value));
+}
+
+void Writer::record(const Record& record) {
+    size_t flags_pos = buffer.size();
+    buffer.push_back(0);
+    uint8_t flags = 0;
+
+    if (record.PC != state.expected_PC) {
+        flags |= PC_JUMP;
+        put_varint(zigzag(record.PC - state.expected_PC));
+    }
+
+    auto it = state.raw_bytes.find(record.PC);
+    if (it == state.raw_bytes.end() || it->second != record.raw_bytes) {
+        flags |= RAW;
+        for (int i = 0; i < 4; i++)
+            buffer.push_back(static_cast<uint8_t>(record.raw_bytes >> (8 * i)));
+        state.raw_bytes[record.PC] = record.raw_bytes;
+    }
+
+    if (record.is_memory) {
+        flags |= MEMORY;
+        put_varint(zigzag(record.memory_addr - state.memory_addr));
+        state.memory_addr = record.memory_addr;
+    }
+
+    if (record.new_PC != record.PC + 4) {
+        flags |= TAKEN;
+        put_varint(zigzag(record.new_PC - record.PC));
+    }
+
+    if (record.has_rd_value) {
+        flags |= RD_VALUE;
+        uint32_t& last = state.rd_values[get_rd(record.raw_bytes)];
+        put_varint(zigzag(record.rd_value - last));
+        last = record.rd_value;
+    }
+
+    buffer[flags_pos] = flags;
+    state.expected_PC = record.new_PC;
+    records++;
+
+    if (buffer.size() >= CHUNK_SIZE)
+        flush();
+}
+
+void Writer::print_stats() const {
+    uint64_t total = bytes + buffer.size();
+    std::cout << std::dec << "Trace records: " << records << std::endl;
+    std::cout << "Trace bytes: " << total << std::endl;
+    if (records != 0)
+        std::cout << "Trace bytes per instruction: " << static_cast<double>(total) / records << std::endl;
+}
+
+Reader::Reader(const char* file_name) :
+    buffer(CHUNK_SIZE)
+{
+    fd = open(file_name, O_RDONLY, 0);
+    if (fd < 0)
+        err(EXIT_FAILURE, "Can't open trace file");
+    refill();
+    if (end - pos < sizeof(MAGIC) || memcmp(buffer.data() + pos, MAGIC, sizeof(MAGIC)) != 0)
+        errx(EXIT_FAILURE, "input file is not a trace");
+    pos += sizeof(MAGIC);
+    decode();
+}
+
+Reader::~Reader() {
+    ::close(fd);
+}
+
+// Keeps at least one whole record buffered unless the file ends first.
+void Reader::refill() {
+    if (is_eof || end - pos >= MAX_RECORD_SIZE)
+        return;
+    memmove(buffer.data(), buffer.data() + pos, end - pos);
+    end -= pos;
+    pos = 0;
+    while (!is_eof && end < buffer.size()) {
+        ssize_t got = read(fd, buffer.data() + end, buffer.size() - end);
+        if (got < 0)
+            err(EXIT_FAILURE, "Can't read trace file");
+        if (got == 0)
+            is_eof = true;
+        end += got;
+    }
+}
+
+uint32_t Reader::get_varint() {
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (pos == end)
+            errx(EXIT_FAILURE, "trace file is truncated");
+        uint8_t byte = buffer[pos++];
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+            return value;
+    }
+    errx(EXIT_FAILURE, "trace file is corrupted");
+}
+
+void Reader::decode() {
+    refill();
+    if (pos == end) {
+        has_next = false;
+        return;
+    }
+
+    uint8_t flags = buffer[pos++];
+    Record& record = next_record;
+
+    record.PC = state.expected_PC;
+    if (flags & PC_JUMP)
+        record.PC += unzigzag(get_varint());
+
+    if (flags & RAW) {
+        if (end - pos < 4)
+            errx(EXIT_FAILURE, "trace file is truncated");
+        record.raw_bytes = 0;
+        for (int i = 0; i < 4; i++)
+            record.raw_bytes |= static_cast<uint32_t>(buffer[pos++]) << (8 * i);
+        state.raw_bytes[record.PC] = record.raw_bytes;
+    } else {
+        auto it = state.raw_bytes.find(record.PC);
+        if (it == state.raw_bytes.end())
+            errx(EXIT_FAILURE, "trace file is corrupted");
+        record.raw_bytes = it->second;
+    }
+
+    record.is_memory = (flags & MEMORY) != 0;
+    if (record.is_memory) {
+        state.memory_addr += unzigzag(get_varint());
+        record.memory_addr = state.memory_addr;
+    } else {
+        record.memory_addr = NO_VAL32;
+    }
+
+    record.new_PC = record.PC + 4;
+    if (flags & TAKEN)
+        record.new_PC = record.PC + unzigzag(get_varint());
+
+    record.has_rd_value = (flags & RD_VALUE) != 0;
+    if (record.has_rd_value) {
+        uint32_t& last = state.rd_values[get_rd(record.raw_bytes)];
+        last += unzigzag(get_varint());
+        record.rd_value = last;
+    } else {
+        record.rd_value = NO_VAL32;
+    }
+
+    state.expected_PC = record.new_PC;
+    has_next = true;
+}
+
+}
@@ -0,0 +1,96 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <array>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "consts.h"
+
+// Binary instruction trace: PC, raw bits, effective address, branch
+// outcome and the value written to rd per retired instruction. Records are
+// delta-encoded against the previous one:
+//   flags          PC_JUMP | RAW | MEMORY | TAKEN | RD_VALUE
+//   [PC_JUMP]      zigzag varint, PC minus the expected PC
+//   [RAW]          4 bytes, only when the bits at this PC changed
+//   [MEMORY]       zigzag varint, address minus the previous address
+//   [TAKEN]        zigzag varint, new PC minus PC
+//   [RD_VALUE]     zigzag varint, value minus the last one written to the
+//                  same rd (bits 11:7 of the raw bits)
+// Loads and writes to $zero carry no value; PerfSim loads it from memory.
+// Files are written and read in fixed-size chunks.
+namespace trace {
+
+struct Record {
+    uint32_t PC = NO_VAL32;
+    uint32_t raw_bytes = 0;
+    uint32_t new_PC = NO_VAL32;
+    bool is_memory = false;
+    uint32_t memory_addr = NO_VAL32;
+    bool has_rd_value = false;
+    uint32_t rd_value = NO_VAL32;
+};
+
+// Encoder and decoder share the state the deltas refer to.
+struct DeltaState {
+    uint32_t expected_PC = NO_VAL32;
+    uint32_t memory_addr = 0;
+    std::unordered_map<uint32_t, uint32_t> raw_bytes;
+    std::array<uint32_t, 32> rd_values = {};
+};
+
+class Writer {
+private:
+    int fd = -1;
+    std::vector<uint8_t> buffer;
+    DeltaState state;
+
+    uint64_t records = 0;
+    uint64_t bytes = 0;
+
+    void flush();
+    void put_varint(uint32_t value);
+
+public:
+    explicit Writer(const char* file_name);
+    ~Writer();
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    void record(const Record& record);
+    void close();
+
+    void print_stats() const;
+};
+
+class Reader {
+private:
+    int fd = -1;
+    std::vector<uint8_t> buffer;
+    size_t pos = 0;
+    size_t end = 0;
+    bool is_eof = false;
+    DeltaState state;
+
+    Record next_record;
+    bool has_next = false;
+
+    void refill();
+    uint32_t get_varint();
+    void decode();
+
+public:
+    explicit Reader(const char* file_name);
+    ~Reader();
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    // nullptr once the trace is exhausted.
+    const Record* peek() const { return has_next ? &next_record : nullptr; }
+    void advance() { decode(); }
+};
+
+}
+
+#endif
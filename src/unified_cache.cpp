@@ -0,0 +1,274 @@
+#include "unified_cache.h"
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+const char* const Inclusion::names[MAX] = { "INCLUSIVE", "EXCLUSIVE", "NINE" };
+
+UnifiedCache::UnifiedCache(LinePort& next_level, uint32_t num_ways, uint32_t num_sets, uint32_t line_size_in_bytes,
+                           uint32_t latency, uint32_t beat_latency, uint32_t policy, uint32_t inclusion)
+    : next_level(next_level)
+    , num_ways(num_ways)
+    , num_sets(num_sets)
+    , line_size_in_bytes(line_size_in_bytes)
+    , latency(latency)
+    , beat_latency(beat_latency)
+    , inclusion(inclusion)
+    , tags(size_t(num_sets) * num_ways, 0)
+    , data(size_t(num_sets) * num_ways * line_size_in_bytes)
+    , bypass(line_size_in_bytes)
+    , policy(ReplacementPolicy::create(policy, num_sets, num_ways))
+    {}
+
+void UnifiedCache::start(request_type::Request type, uint32_t addr, uint8_t* line, uint32_t num_bytes,
+                         uint32_t first_offset, bool is_dirty) {
+    burst = Burst();
+    burst.request_type = type;
+    burst.addr = addr;
+    burst.line = line;
+    burst.num_bytes = num_bytes;
+    burst.first_offset = first_offset;
+    burst.is_dirty = is_dirty;
+    burst.set = get_set(addr);
+    status = BurstStatus{0, false};
+    is_owned = true;
+    // Write-backs from above are counted there.
+    const bool is_read = type == request_type::read;
+    stats.accesses += is_read;
+
+    // The caches above are not coherent, so an exclusive level, which
+    // takes clean lines back from them, must not keep stale copies above
+    // once a newer line has been written back.
+    if (!is_read && is_dirty && is_exclusive())
+        for (auto* level : upper_levels)
+            level->invalidate_clean(get_line_addr(addr), line_size_in_bytes);
+
+    const auto [is_hit, way] = lookup(addr);
+    if (is_hit) {
+        policy->on_hit(burst.set, way);
+        burst.is_hit = true;
+        burst.way = way;
+        burst.data = get_line_data(burst.set, way);
+        start_transfer();
+        return;
+    }
+
+    stats.misses += is_read;
+    if (is_read && is_exclusive()) {
+        burst.data = bypass.data();
+        is_fill_needed = true;
+        phase = Phase::FILL;
+        return;
+    }
+    allocate();
+}
+
+// Takes an invalid way or the policy's victim, then writes the victim
+// back and fetches the line as needed. A line the level above sends
+// whole needs no fetch.
+void UnifiedCache::allocate() {
+    const uint32_t set = burst.set;
+    const uint32_t* set_tags = &tags[get_index(set, 0)];
+    uint32_t way = 0;
+    while (way < num_ways && (set_tags[way] & VALID))
+        way++;
+    if (way == num_ways)
+        way = policy->get_victim(set);
+    policy->on_fill(set, way);
+    burst.way = way;
+    burst.data = get_line_data(set, way);
+    is_fill_needed = burst.request_type == request_type::read || burst.num_bytes < line_size_in_bytes;
+
+    uint32_t& tag = tags[get_index(set, way)];
+    const uint32_t victim = tag;
+    tag = 0;
+    if (victim & VALID) {
+        victim_addr = get_entry_addr(victim);
+        is_victim_dirty = victim & DIRTY;
+        if (inclusion == Inclusion::INCLUSIVE && invalidate_upper_levels(victim_addr, burst.data))
+            is_victim_dirty = true;
+        if (is_victim_dirty || next_level.is_exclusive()) {
+            stats.writebacks += is_victim_dirty;
+            phase = Phase::WRITE_BACK;
+            return;
+        }
+    }
+
+    if (is_fill_needed) {
+        phase = Phase::FILL;
+        return;
+    }
+    install();
+    start_transfer();
+}
+
+void UnifiedCache::install() {
+    tags[get_index(burst.set, burst.way)] = make_tag_entry(burst.addr, VALID);
+}
+
+void UnifiedCache::start_transfer() {
+    phase = Phase::TRANSFER;
+    cycles_left = latency;
+}
+
+void UnifiedCache::process_next_level() {
+    if (!is_sent) {
+        if (next_level.is_busy())
+            return;
+        if (phase == Phase::WRITE_BACK)
+            next_level.send_write_burst(victim_addr, burst.data, line_size_in_bytes, is_victim_dirty);
+        else
+            next_level.send_read_burst(get_line_addr(burst.addr), burst.data, line_size_in_bytes, 0);
+        is_sent = true;
+        return;
+    }
+
+    const auto lower = next_level.get_burst_status();
+    if (!lower.is_completed)
+        return;
+    next_level.release();
+    is_sent = false;
+
+    if (phase == Phase::WRITE_BACK && is_fill_needed) {
+        phase = Phase::FILL;
+        return;
+    }
+    if (burst.data != bypass.data())
+        install();
+    start_transfer();
+}
+
+// Clean write-backs leave a line that is already here alone: the copy
+// here may be newer, written back by the other cache above.
+void UnifiedCache::transfer_beat() {
+    const uint32_t bus_width = get_bus_width();
+    const uint32_t offset = (burst.first_offset + status.bytes_done) % burst.num_bytes;
+    uint8_t* line = burst.data + burst.addr % line_size_in_bytes + offset;
+    if (burst.request_type == request_type::read)
+        std::memcpy(burst.line + offset, line, bus_width);
+    else if (burst.is_dirty || !burst.is_hit)
+        std::memcpy(line, burst.line + offset, bus_width);
+
+    status.bytes_done += bus_width;
+    cycles_left = beat_latency;
+    if (status.bytes_done == burst.num_bytes)
+        finish();
+}
+
+void UnifiedCache::finish() {
+    status.is_completed = true;
+    phase = Phase::IDLE;
+    if (burst.data == bypass.data())
+        return;
+
+    uint32_t& tag = tags[get_index(burst.set, burst.way)];
+    if (burst.request_type == request_type::write) {
+        if (burst.is_dirty)
+            tag |= DIRTY;
+    }
+    else if (is_exclusive() && !(tag & DIRTY)) {
+        // The line moves up.
+        tag = 0;
+    }
+}
+
+void UnifiedCache::clock() {
+    switch (phase) {
+        case Phase::IDLE:
+            break;
+        case Phase::WRITE_BACK:
+        case Phase::FILL:
+            process_next_level();
+            break;
+        case Phase::TRANSFER:
+            if (--cycles_left == 0)
+                transfer_beat();
+            break;
+    }
+}
+
+void UnifiedCache::warm_up(const CacheWarmer& warmer, const Memory& memory) {
+    assert(warmer.get_num_ways() == num_ways);
+    assert(warmer.get_num_sets() == num_sets);
+    assert(warmer.get_line_size() == line_size_in_bytes);
+    assert(warmer.get_policy().get_kind() == policy->get_kind());
+    assert(warmer.is_exclusive() == is_exclusive());
+
+    for (uint32_t set = 0; set < num_sets; set++) {
+        for (uint32_t way = 0; way < num_ways; way++) {
+            const auto& warm_line = warmer.get_line(way, set);
+            uint32_t& tag = tags[get_index(set, way)];
+            tag = 0;
+            if (warm_line.is_valid) {
+                tag = make_tag_entry(warm_line.addr, VALID | (warm_line.is_dirty ? DIRTY : 0));
+                uint8_t* line = get_line_data(set, way);
+                for (uint32_t i = 0; i < line_size_in_bytes; i += 4)
+                    store_bytes<4>(line + i, memory.read<4>(warm_line.addr + i));
+            }
+        }
+    }
+    policy = warmer.get_policy().clone();
+}
+
+bool UnifiedCache::invalidate_upper_levels(uint32_t addr, uint8_t* line) {
+    bool is_dirty = false;
+    for (auto* level : upper_levels)
+        is_dirty |= level->back_invalidate(addr, line_size_in_bytes, line);
+    return is_dirty;
+}
+
+// The levels above are invalidated even where this level has no copy,
+// since it need not be inclusive itself.
+bool UnifiedCache::back_invalidate(uint32_t addr, uint32_t num_bytes, uint8_t* data) {
+    bool is_dirty = false;
+    for (uint32_t offset = 0; offset < num_bytes; offset += line_size_in_bytes) {
+        const auto [is_hit, way] = lookup(addr + offset);
+        if (!is_hit) {
+            is_dirty |= invalidate_upper_levels(addr + offset, data + offset);
+            continue;
+        }
+        const uint32_t set = get_set(addr + offset);
+        uint8_t* line = get_line_data(set, way);
+        uint32_t& tag = tags[get_index(set, way)];
+        if (invalidate_upper_levels(addr + offset, line))
+            tag |= DIRTY;
+        if (tag & DIRTY) {
+            std::memcpy(data + offset, line, line_size_in_bytes);
+            is_dirty = true;
+        }
+        tag = 0;
+        stats.back_invalidations++;
+    }
+    return is_dirty;
+}
+
+void UnifiedCache::invalidate_clean(uint32_t addr, uint32_t num_bytes) {
+    for (uint32_t offset = 0; offset < num_bytes; offset += line_size_in_bytes) {
+        const auto [is_hit, way] = lookup(addr + offset);
+        uint32_t& tag = tags[get_index(get_set(addr + offset), way % num_ways)];
+        if (is_hit && !(tag & DIRTY)) {
+            tag = 0;
+            stats.back_invalidations++;
+        }
+        for (auto* level : upper_levels)
+            level->invalidate_clean(addr + offset, line_size_in_bytes);
+    }
+}
+
+std::pair<bool, uint32_t> UnifiedCache::lookup(uint32_t addr) const {
+    const uint32_t* set_tags = &tags[get_index(get_set(addr), 0)];
+    const uint32_t key = make_tag_entry(addr, VALID);
+    for (uint32_t way = 0; way < num_ways; ++way) {
+        if ((set_tags[way] & ~DIRTY) == key)
+            return {true, way};
+    }
+    return {false, 0xBAAAAAAD};
+}
+
+void UnifiedCache::print_stats(const char* name) const {
+    std::cout << std::dec << name << " accesses: " << stats.accesses << ", misses: " << stats.misses
+              << ", hit rate: " << (stats.accesses ? 1.0 - double(stats.misses) / stats.accesses : 0)
+              << ", writebacks: " << stats.writebacks << ", back-invalidations: " << stats.back_invalidations
+              << ", policy: " << policy->get_name() << ", inclusion: " << Inclusion::names[inclusion] << std::endl;
+}
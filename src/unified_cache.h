@@ -0,0 +1,133 @@
+#ifndef UNIFIED_CACHE_H
+#define UNIFIED_CACHE_H
+
+#include <memory>
+#include <vector>
+
+#include "memory.h"
+#include "line_port.h"
+#include "replacement_policy.h"
+#include "cache_warmer.h"
+
+// A lower-level cache (L2, L3) shared by the levels above it. It serves
+// one burst at a time: a hit starts answering after the tag latency, a
+// miss first writes back the victim and fetches the line from the next
+// level. Lines may be wider than the ones above; an exclusive level must
+// use the line size of the level above it.
+class UnifiedCache : public LinePort, public LineHolder {
+public:
+    struct Stats {
+        // Line fetches from the levels above.
+        uint64_t accesses = 0;
+        uint64_t misses = 0;
+        // Dirty lines written to the next level.
+        uint64_t writebacks = 0;
+        // Lines dropped because the inclusive level below evicted them.
+        uint64_t back_invalidations = 0;
+    };
+
+    UnifiedCache(LinePort& next_level, uint32_t num_ways, uint32_t num_sets, uint32_t line_size_in_bytes,
+                 uint32_t latency, uint32_t beat_latency, uint32_t policy, uint32_t inclusion);
+
+    // Inclusive levels back-invalidate the lines they evict in these.
+    void add_upper_level(LineHolder& level) { upper_levels.push_back(&level); }
+    void clock();
+    // Data comes from memory, which is current during warm-up.
+    void warm_up(const CacheWarmer& warmer, const Memory& memory);
+
+    bool is_busy() const override { return is_owned; }
+    void release() override { is_owned = false; }
+    uint32_t get_bus_width() const override { return next_level.get_bus_width(); }
+    bool is_exclusive() const override { return inclusion == Inclusion::EXCLUSIVE; }
+    void send_read_burst(uint32_t addr, uint8_t* line, uint32_t num_bytes, uint32_t first_offset) override {
+        start(request_type::read, addr, line, num_bytes, first_offset, false);
+    }
+    void send_write_burst(uint32_t addr, uint8_t* line, uint32_t num_bytes, bool is_dirty) override {
+        start(request_type::write, addr, line, num_bytes, 0, is_dirty);
+    }
+    BurstStatus get_burst_status() const override { return status; }
+
+    bool back_invalidate(uint32_t addr, uint32_t num_bytes, uint8_t* data) override;
+    void invalidate_clean(uint32_t addr, uint32_t num_bytes) override;
+
+    Stats get_stats() const { return stats; }
+    void print_stats(const char* name) const;
+
+private:
+    // Same tag layout as Cache.
+    static const uint32_t VALID = 1;
+    static const uint32_t DIRTY = 2;
+    static const uint32_t FLAG_BITS = 2;
+
+    enum class Phase {
+        IDLE,
+        WRITE_BACK,
+        FILL,
+        TRANSFER
+    };
+
+    // The burst of the level above being served.
+    struct Burst {
+        request_type::Request request_type = request_type::read;
+        uint32_t addr = 0xBAAAAAAD;
+        uint8_t* line = nullptr;
+        uint32_t num_bytes = 0;
+        uint32_t first_offset = 0;
+        bool is_dirty = false;
+        bool is_hit = false;
+        uint32_t set = 0xBAAAAAAD;
+        uint32_t way = 0xBAAAAAAD;
+        // Our copy of the line: a way, or the bypass buffer for lines an
+        // exclusive level passes up without keeping.
+        uint8_t* data = nullptr;
+    };
+
+    LinePort& next_level;
+    std::vector<LineHolder*> upper_levels;
+
+    uint32_t num_ways;
+    uint32_t num_sets;
+    uint32_t line_size_in_bytes;
+    uint32_t latency;
+    uint32_t beat_latency;
+    uint32_t inclusion;
+
+    std::vector<uint32_t> tags;
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> bypass;
+    std::unique_ptr<ReplacementPolicy> policy;
+    Stats stats;
+
+    Burst burst;
+    BurstStatus status;
+    bool is_owned = false;
+    Phase phase = Phase::IDLE;
+    uint32_t cycles_left = 0;
+
+    // The write-back or fill in flight to the next level.
+    bool is_sent = false;
+    uint32_t victim_addr = 0xBAAAAAAD;
+    bool is_victim_dirty = false;
+    bool is_fill_needed = false;
+
+    void start(request_type::Request type, uint32_t addr, uint8_t* line, uint32_t num_bytes,
+               uint32_t first_offset, bool is_dirty);
+    void allocate();
+    void install();
+    void start_transfer();
+    void process_next_level();
+    void transfer_beat();
+    void finish();
+    bool invalidate_upper_levels(uint32_t addr, uint8_t* line);
+
+    uint32_t get_set(uint32_t addr) const { return (addr / line_size_in_bytes) & (num_sets - 1); }
+    uint32_t get_line_addr(uint32_t addr) const { return addr - addr % line_size_in_bytes; }
+    size_t get_index(uint32_t set, uint32_t way) const { return size_t(set) * num_ways + way; }
+    uint8_t* get_line_data(uint32_t set, uint32_t way) { return &data[get_index(set, way) * line_size_in_bytes]; }
+    uint32_t make_tag_entry(uint32_t addr, uint32_t flags) const { return (addr / line_size_in_bytes) << FLAG_BITS | flags; }
+    uint32_t get_entry_addr(uint32_t entry) const { return (entry >> FLAG_BITS) * line_size_in_bytes; }
+
+    std::pair<bool, uint32_t> lookup(uint32_t addr) const;
+};
+
+#endif
@@ -28,14 +28,18 @@ private:
     std::vector <Record> memory;
     std::vector <Record> writeback;
 
+    bool is_enabled = true;
+
 public:
     Visualizer(){}
     
-    void record_fetch(Record record) { fetch.push_back(record); }
-    void record_decode(Record record) { decode.push_back(record); }
-    void record_execute(Record record) { execute.push_back(record); }
-    void record_memory(Record record) { memory.push_back(record); }
-    void record_writeback(Record record) { writeback.push_back(record); }
+    void set_enabled(bool value) { is_enabled = value; }
+
+    void record_fetch(Record record) { if (is_enabled) fetch.push_back(record); }
+    void record_decode(Record record) { if (is_enabled) decode.push_back(record); }
+    void record_execute(Record record) { if (is_enabled) execute.push_back(record); }
+    void record_memory(Record record) { if (is_enabled) memory.push_back(record); }
+    void record_writeback(Record record) { if (is_enabled) writeback.push_back(record); }
 
     void print_file();
 };
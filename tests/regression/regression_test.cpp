@@ -0,0 +1,499 @@
+#include <cstring>
+#include <err.h>
+#include <functional>
+#include <iostream>
+#include <string>
+
+#include "../../src/funcsim.h"
+#include "../../src/perfsim.h"
+#include "../../src/checkpoint.h"
+#include "../../src/cache_warmer.h"
+#include "../../src/stack_distance.h"
+
+// Checks of the functional simulator against a plain reference, run by
+// ctest on the programs in tests/regression:
+//   regression_test CASE FILE_NAME
+namespace {
+
+using Registers = std::array<uint32_t, Register::MAX_NUMBER>;
+
+const uint64_t NUM_INSTRUCTIONS = 200000;
+
+// The interpreter loop without any caching: every instruction is decoded
+// from memory right before it executes.
+class Reference {
+private:
+    FuncsimMemory memory;
+    RF rf;
+    uint32_t PC;
+
+public:
+    Reference(const Memory::Pages& image, uint32_t PC) : memory(image), PC(PC) {
+        rf.set_stack_pointer(memory.get_stack_pointer());
+        rf.validate(Register::Names::s0);
+        rf.validate(Register::Names::ra);
+    }
+
+    trace::Record step() {
+        trace::Record record;
+        record.PC = PC;
+        record.raw_bytes = memory.read<4>(PC);
+
+        Instruction instr(record.raw_bytes, PC);
+        rf.read_sources(instr);
+        instr.execute();
+        memory.load_store(instr);
+        rf.writeback(instr);
+        PC = instr.get_new_PC();
+
+        record.new_PC = PC;
+        record.is_memory = instr.is_load() || instr.is_store();
+        record.memory_addr = instr.get_memory_addr();
+        record.has_rd_value = !instr.is_load() && instr.get_rd() != Register::zero();
+        record.rd_value = instr.get_rd_v();
+        return record;
+    }
+
+    uint32_t get_PC() const { return PC; }
+    Registers get_registers() const { return rf.get_values(); }
+};
+
+template <typename A, typename B>
+void check_state(const A& a, const B& b, uint64_t instructions, const char* what) {
+    if (a.get_PC() != b.get_PC())
+        errx(EXIT_FAILURE, "%s: PC 0x%x, expected 0x%x after %lu instructions",
+             what, b.get_PC(), a.get_PC(), static_cast<unsigned long>(instructions));
+    const Registers expected = a.get_registers();
+    const Registers actual = b.get_registers();
+    for (size_t i = 0; i < expected.size(); i++)
+        if (expected[i] != actual[i])
+            errx(EXIT_FAILURE, "%s: %s = 0x%x, expected 0x%x after %lu instructions",
+                 what, Register(i).get_name().c_str(), actual[i], expected[i], static_cast<unsigned long>(instructions));
+}
+
+// The decode cache must never hand out an instruction other than the one
+// in memory at PC, including misaligned PCs and rewritten code.
+void test_decode_cache(const Checkpoint& program) {
+    Reference reference(program.pages, program.PC);
+    FuncSim simulator(program.pages, program.PC);
+    simulator.set_trace(false);
+    for (uint64_t i = 1; i <= NUM_INSTRUCTIONS; i++) {
+        reference.step();
+        simulator.step();
+        check_state(reference, simulator, i, "decode cache");
+    }
+}
+
+// The threaded engine and the JIT against the interpreter. The first
+// instructions are run one at a time so every retired instruction is
+// compared; the rest in chunks, so whole blocks and translated code run
+// between the comparisons.
+void test_engines(const Checkpoint& program) {
+    const uint64_t STEPPED = 10000;
+    const uint64_t chunks[] = { 17, 256, 4093 };
+
+    FuncSim interpreter(program.pages, program.PC, FuncSim::Engine::INTERPRETER);
+    FuncSim threaded(program.pages, program.PC, FuncSim::Engine::THREADED);
+    FuncSim jit(program.pages, program.PC, FuncSim::Engine::JIT);
+    interpreter.set_trace(false);
+
+    uint64_t instructions = 0;
+    for (size_t i = 0; instructions < NUM_INSTRUCTIONS; i++) {
+        uint64_t n = (instructions < STEPPED) ? 1 : chunks[i % 3];
+        interpreter.run(n);
+        threaded.run(n);
+        jit.run(n);
+        instructions += n;
+        check_state(interpreter, threaded, instructions, "threaded");
+        check_state(interpreter, jit, instructions, "jit");
+    }
+}
+
+// Saves a checkpoint halfway, loads it back and runs the restored copy
+// next to the original.
+void test_checkpoint(const Checkpoint& program) {
+    const char* file_name = "regression.checkpoint";
+    const uint64_t half = NUM_INSTRUCTIONS / 2;
+
+    FuncSim original(program.pages, program.PC, FuncSim::Engine::THREADED);
+    original.run(half);
+
+    Checkpoint saved;
+    saved.PC = original.get_PC();
+    saved.instructions = half;
+    saved.registers = original.get_registers();
+    saved.pages = original.get_memory_pages();
+    saved.save(file_name);
+
+    if (!Checkpoint::is_checkpoint(file_name))
+        errx(EXIT_FAILURE, "checkpoint: saved file is not recognized");
+    Checkpoint restored = Checkpoint::load_program(file_name);
+    if (!restored.is_restored || restored.PC != saved.PC || restored.instructions != saved.instructions
+        || restored.registers != saved.registers)
+        errx(EXIT_FAILURE, "checkpoint: header does not round-trip");
+
+    // Zero pages may be dropped; every other page must come back as is.
+    const Memory::Page zero = {};
+    for (const auto& page : saved.pages) {
+        auto it = restored.pages.find(page.first);
+        const Memory::Page& restored_page = (it == restored.pages.end()) ? zero : *it->second;
+        if (*page.second != restored_page)
+            errx(EXIT_FAILURE, "checkpoint: page 0x%x does not round-trip", page.first);
+    }
+    for (const auto& page : restored.pages)
+        if (saved.pages.count(page.first) == 0)
+            errx(EXIT_FAILURE, "checkpoint: page 0x%x was not saved", page.first);
+
+    FuncSim resumed(restored.pages, restored.PC, FuncSim::Engine::THREADED);
+    resumed.set_registers(restored.registers);
+    for (uint64_t instructions = half; instructions < NUM_INSTRUCTIONS; instructions += 1000) {
+        original.run(1000);
+        resumed.run(1000);
+        check_state(original, resumed, instructions + 1000, "checkpoint");
+    }
+}
+
+// Feeds one access stream to several cache models.
+class CacheModels : public CacheModel {
+private:
+    std::vector<CacheModel*> models;
+    uint32_t line_size_in_bytes;
+
+public:
+    explicit CacheModels(uint32_t line_size_in_bytes) : line_size_in_bytes(line_size_in_bytes) {}
+
+    void add(CacheModel* model) { models.push_back(model); }
+    void access(uint32_t addr, bool is_write) override {
+        for (auto* model : models)
+            model->access(addr, is_write);
+    }
+    void repeat(uint32_t n) override {
+        for (auto* model : models)
+            model->repeat(n);
+    }
+    uint32_t get_line_size() const override { return line_size_in_bytes; }
+};
+
+// The single-pass miss ratios must equal those of LRU caches simulated
+// one geometry at a time.
+void test_stack_distance(const Checkpoint& program) {
+    const uint32_t line = 16;
+    const uint32_t max_sets = 64;
+    const uint32_t max_ways = 8;
+
+    StackDistance icache(line, max_sets, max_ways);
+    StackDistance dcache(line, max_sets, max_ways);
+    CacheModels icache_models(line);
+    CacheModels dcache_models(line);
+    icache_models.add(&icache);
+    dcache_models.add(&dcache);
+
+    std::vector<std::unique_ptr<CacheWarmer>> icache_lru;
+    std::vector<std::unique_ptr<CacheWarmer>> dcache_lru;
+    for (uint32_t sets = 1; sets <= max_sets; sets *= 4) {
+        for (uint32_t ways = 1; ways <= max_ways; ways *= 2) {
+            icache_lru.push_back(std::make_unique<CacheWarmer>(ways, sets, line, ReplacementPolicy::LRU));
+            dcache_lru.push_back(std::make_unique<CacheWarmer>(ways, sets, line, ReplacementPolicy::LRU));
+            icache_models.add(icache_lru.back().get());
+            dcache_models.add(dcache_lru.back().get());
+        }
+    }
+
+    FuncSim simulator(program.pages, program.PC, FuncSim::Engine::THREADED);
+    simulator.set_warmers(&icache_models, &dcache_models);
+    simulator.run(NUM_INSTRUCTIONS);
+
+    auto check = [](const StackDistance& profile, const CacheWarmer& lru, const char* name) {
+        double expected = static_cast<double>(lru.get_misses()) / (lru.get_hits() + lru.get_misses());
+        double actual = profile.get_miss_ratio(lru.get_num_sets(), lru.get_num_ways());
+        if (actual != expected)
+            errx(EXIT_FAILURE, "stack distance: %s %u sets x %u ways miss ratio %f, LRU cache %f",
+                 name, lru.get_num_sets(), lru.get_num_ways(), actual, expected);
+    };
+    for (const auto& lru : icache_lru)
+        check(icache, *lru, "icache");
+    for (const auto& lru : dcache_lru)
+        check(dcache, *lru, "dcache");
+}
+
+// The regression program parks in an endless loop with a mark in s4 once
+// one of its self-checks fails. The pipeline must not get there with any
+// predictor or resolution stage. Several checks read $zero right behind a
+// jump, so they fail if its link value gets forwarded into them. Caches
+// with a prefetcher must issue prefetches even with one MSHR or none.
+void test_perfsim(const Checkpoint& program) {
+    const char* const configs[][2] = {
+        { "BRANCH_PREDICTOR=NONE",   "BRANCH_RESOLUTION=MEMORY" },
+        { "BRANCH_PREDICTOR=STATIC", "BRANCH_RESOLUTION=MEMORY" },
+        { "BRANCH_PREDICTOR=GSHARE", "BRANCH_RESOLUTION=EXECUTE" },
+        { "BRANCH_PREDICTOR=TAGE",   "BRANCH_RESOLUTION=DECODE" },
+        { "ICACHE_PREFETCHER=NEXT_LINE", "MSHRS=0" },
+        { "DCACHE_PREFETCHER=NEXT_LINE", "MSHRS=1" },
+    };
+    // The mark is whatever "lui s4, 0xbad00" leaves in s4.
+    Instruction mark(0xbad00a37, 0);
+    mark.execute();
+
+    for (const auto& assignments : configs) {
+        Config config;
+        for (const char* assignment : assignments)
+            config.set(assignment);
+        config.validate();
+
+        PerfSim simulator(program.pages, program.PC, config);
+        simulator.set_trace(false);
+        simulator.set_visual(false);
+        simulator.simulate(NUM_INSTRUCTIONS / 4);
+        if (simulator.get_registers()[Register(Register::Names::s4).id()] == mark.get_rd_v())
+            errx(EXIT_FAILURE, "perfsim: self-check failed with %s %s", assignments[0], assignments[1]);
+        if ((config.icache_prefetcher != Prefetcher::NONE && simulator.get_icache_stats().prefetches == 0)
+            || (config.dcache_prefetcher != Prefetcher::NONE && simulator.get_dcache_stats().prefetches == 0))
+            errx(EXIT_FAILURE, "perfsim: no prefetches with %s %s", assignments[0], assignments[1]);
+    }
+}
+
+// Every level warmed functionally must keep the lines its inclusive level
+// below holds, the threaded engine must warm it as the interpreter does,
+// and PerfSim started from the warmed hierarchy must read the data the
+// program wrote during fast-forward.
+void test_warm_up(const Checkpoint& program) {
+    const char* const inclusions[] = { "INCLUSIVE", "EXCLUSIVE", "NINE" };
+    Instruction mark(0xbad00a37, 0);
+    mark.execute();
+
+    auto holds = [](const CacheWarmer& level, uint32_t addr) {
+        for (uint32_t set = 0; set < level.get_num_sets(); set++)
+            for (uint32_t way = 0; way < level.get_num_ways(); way++) {
+                const auto& line = level.get_line(way, set);
+                if (line.is_valid && line.addr == addr - addr % level.get_line_size())
+                    return true;
+            }
+        return false;
+    };
+    auto check_inclusion = [&](const CacheWarmer& upper, const CacheWarmer& lower, const char* name) {
+        for (uint32_t set = 0; set < upper.get_num_sets(); set++)
+            for (uint32_t way = 0; way < upper.get_num_ways(); way++) {
+                const auto& line = upper.get_line(way, set);
+                if (line.is_valid && !holds(lower, line.addr))
+                    errx(EXIT_FAILURE, "warm up: %s line 0x%x is missing below", name, line.addr);
+            }
+    };
+    auto check_same = [](const CacheWarmer& expected, const CacheWarmer& actual, const char* inclusion, const char* name) {
+        if (actual.get_hits() != expected.get_hits() || actual.get_misses() != expected.get_misses())
+            errx(EXIT_FAILURE, "warm up: threaded %s %s has %lu misses, interpreted %lu", inclusion, name,
+                 static_cast<unsigned long>(actual.get_misses()), static_cast<unsigned long>(expected.get_misses()));
+        for (uint32_t set = 0; set < expected.get_num_sets(); set++)
+            for (uint32_t way = 0; way < expected.get_num_ways(); way++) {
+                const auto& a = actual.get_line(way, set);
+                const auto& e = expected.get_line(way, set);
+                if (a.is_valid != e.is_valid || (e.is_valid && (a.addr != e.addr || a.is_dirty != e.is_dirty)))
+                    errx(EXIT_FAILURE, "warm up: threaded %s %s differs in set %u, way %u", inclusion, name, set, way);
+            }
+    };
+
+    for (const char* inclusion : inclusions) {
+        Config config;
+        for (const std::string assignment : { "CACHE_SET=4", "CACHE_WAY=2", "CACHE_LEVELS=3",
+                                              "L2_SET=8", "L2_WAY=2", "L2_LINE=16", "L3_SET=16", "L3_WAY=2", "L3_LINE=16" })
+            config.set(assignment);
+        config.set("L2_INCLUSION", inclusion);
+        config.set("L3_INCLUSION", inclusion);
+        config.validate();
+
+        HierarchyWarmer warmer(config);
+        FuncSim fsim(program.pages, program.PC, FuncSim::Engine::THREADED);
+        fsim.set_warmers(&warmer.icache, &warmer.dcache);
+        fsim.run(NUM_INSTRUCTIONS / 2);
+        if (warmer.levels[0]->get_hits() == 0 || warmer.levels[1]->get_hits() + warmer.levels[1]->get_misses() == 0)
+            errx(EXIT_FAILURE, "warm up: %s lower levels saw no traffic", inclusion);
+        // The interpreter feeds the warmers one instruction at a time; the
+        // threaded engine must leave every level in the same state.
+        HierarchyWarmer interpreted(config);
+        FuncSim interpreter(program.pages, program.PC, FuncSim::Engine::INTERPRETER);
+        interpreter.set_trace(false);
+        interpreter.set_warmers(&interpreted.icache, &interpreted.dcache);
+        interpreter.run(NUM_INSTRUCTIONS / 2);
+        check_same(interpreted.icache, warmer.icache, inclusion, "icache");
+        check_same(interpreted.dcache, warmer.dcache, inclusion, "dcache");
+        check_same(*interpreted.levels[0], *warmer.levels[0], inclusion, "L2");
+        check_same(*interpreted.levels[1], *warmer.levels[1], inclusion, "L3");
+
+        if (strcmp(inclusion, "INCLUSIVE") == 0) {
+            check_inclusion(warmer.icache, *warmer.levels[0], "icache");
+            check_inclusion(warmer.dcache, *warmer.levels[0], "dcache");
+            check_inclusion(*warmer.levels[0], *warmer.levels[1], "L2");
+        }
+
+        PerfSim simulator(fsim.get_memory_pages(), fsim.get_PC(), config);
+        simulator.set_trace(false);
+        simulator.set_visual(false);
+        simulator.set_registers(fsim.get_registers());
+        simulator.warm_up(warmer);
+        simulator.simulate(NUM_INSTRUCTIONS / 8);
+        if (simulator.get_registers()[Register(Register::Names::s4).id()] == mark.get_rd_v())
+            errx(EXIT_FAILURE, "warm up: self-check failed after warming a %s hierarchy", inclusion);
+    }
+}
+
+// The threaded engine trains the branch predictor on the jump or branch
+// ending each block, the interpreter on every instruction; both must see
+// the same jumps and branches in the same order.
+void test_branch_warm_up(const Checkpoint& program) {
+    Config config;
+    config.set("BRANCH_PREDICTOR", "TAGE");
+    auto make_predictor = [&config]() {
+        return BranchPredictor(config.branch_predictor, config.btb_entries, config.predictor_entries,
+                               config.history_length, config.ras_depth);
+    };
+    BranchPredictor interpreted = make_predictor();
+    BranchPredictor threaded = make_predictor();
+
+    FuncSim interpreter(program.pages, program.PC, FuncSim::Engine::INTERPRETER);
+    FuncSim engine(program.pages, program.PC, FuncSim::Engine::THREADED);
+    interpreter.set_trace(false);
+    interpreter.set_branch_warmer(&interpreted);
+    engine.set_branch_warmer(&threaded);
+    interpreter.run(NUM_INSTRUCTIONS / 2);
+    engine.run(NUM_INSTRUCTIONS / 2);
+
+    const auto expected = interpreted.get_stats();
+    const auto actual = threaded.get_stats();
+    if (expected.branches == 0 || expected.jumps == 0)
+        errx(EXIT_FAILURE, "branch warm up: no jumps or branches trained");
+    if (actual.branches != expected.branches || actual.jumps != expected.jumps
+        || actual.direction_mispredicts != expected.direction_mispredicts
+        || actual.target_mispredicts != expected.target_mispredicts
+        || actual.return_mispredicts != expected.return_mispredicts)
+        errx(EXIT_FAILURE, "branch warm up: threaded engine trained %lu branches, %lu jumps, %lu mispredicts;"
+             " interpreter %lu, %lu, %lu",
+             static_cast<unsigned long>(actual.branches), static_cast<unsigned long>(actual.jumps),
+             static_cast<unsigned long>(actual.direction_mispredicts + actual.target_mispredicts),
+             static_cast<unsigned long>(expected.branches), static_cast<unsigned long>(expected.jumps),
+             static_cast<unsigned long>(expected.direction_mispredicts + expected.target_mispredicts));
+}
+
+// A trace written by the interpreter must read back as the records of
+// the reference, and drive PerfSim over exactly that many instructions.
+void test_trace(const Checkpoint& program) {
+    const char* file_name = "regression.trace";
+
+    trace::Writer writer(file_name);
+    FuncSim simulator(program.pages, program.PC);
+    simulator.set_trace(false);
+    simulator.set_trace_writer(&writer);
+    simulator.run(NUM_INSTRUCTIONS);
+    writer.close();
+
+    Reference reference(program.pages, program.PC);
+    trace::Reader reader(file_name);
+    for (uint64_t i = 0; i < NUM_INSTRUCTIONS; i++) {
+        const trace::Record expected = reference.step();
+        const trace::Record* actual = reader.peek();
+        if (actual == nullptr)
+            errx(EXIT_FAILURE, "trace: ends after %lu records", static_cast<unsigned long>(i));
+        if (actual->PC != expected.PC || actual->raw_bytes != expected.raw_bytes || actual->new_PC != expected.new_PC
+            || actual->is_memory != expected.is_memory || (expected.is_memory && actual->memory_addr != expected.memory_addr)
+            || actual->has_rd_value != expected.has_rd_value || (expected.has_rd_value && actual->rd_value != expected.rd_value))
+            errx(EXIT_FAILURE, "trace: record %lu at 0x%x does not round-trip", static_cast<unsigned long>(i), expected.PC);
+        reader.advance();
+    }
+    if (reader.peek() != nullptr)
+        errx(EXIT_FAILURE, "trace: records past the end");
+
+    trace::Reader replay(file_name);
+    PerfSim perfsim(program.pages, program.PC);
+    perfsim.set_trace(false);
+    perfsim.set_visual(false);
+    perfsim.set_replay(&replay);
+    perfsim.simulate(NUM_INSTRUCTIONS + 1);
+    if (perfsim.get_stats().instructions != NUM_INSTRUCTIONS)
+        errx(EXIT_FAILURE, "trace: PerfSim replayed %u instructions", perfsim.get_stats().instructions);
+}
+
+// Replay must take as many cycles as execution-driven simulation and
+// leave the registers of the program. The execution-driven pipeline runs
+// stale bytes once the program patches its own code, as its icache does
+// not see stores, and leaves the traced path at instruction 9535; the
+// comparison stops before that.
+void test_replay(const Checkpoint& program) {
+    const uint32_t REPLAYED = 9000;
+    const char* const configs[][2] = {
+        { "BRANCH_PREDICTOR=NONE",   "MSHRS=0" },
+        { "BRANCH_PREDICTOR=STATIC", "BRANCH_RESOLUTION=MEMORY" },
+        { "BRANCH_PREDICTOR=GSHARE", "STORE_BUFFER=4" },
+        { "BRANCH_PREDICTOR=TAGE",   "BRANCH_RESOLUTION=DECODE" },
+    };
+    const char* file_name = "regression.replay.trace";
+
+    trace::Writer writer(file_name);
+    FuncSim functional(program.pages, program.PC);
+    functional.set_trace(false);
+    functional.set_trace_writer(&writer);
+    functional.run(REPLAYED);
+    // PerfSim fetches ahead of the last retired instruction.
+    const Registers expected = functional.get_registers();
+    functional.run(REPLAYED);
+    writer.close();
+
+    for (const auto& assignments : configs) {
+        Config config;
+        for (const char* assignment : assignments)
+            config.set(assignment);
+        config.validate();
+
+        PerfSim executed(program.pages, program.PC, config);
+        executed.set_trace(false);
+        executed.set_visual(false);
+        executed.simulate(REPLAYED);
+
+        trace::Reader reader(file_name);
+        PerfSim replayed(program.pages, program.PC, config);
+        replayed.set_trace(false);
+        replayed.set_visual(false);
+        replayed.set_replay(&reader);
+        replayed.simulate(REPLAYED);
+
+        if (replayed.get_stats().cycles != executed.get_stats().cycles)
+            errx(EXIT_FAILURE, "replay: %u cycles, executed %u with %s %s",
+                 replayed.get_stats().cycles, executed.get_stats().cycles, assignments[0], assignments[1]);
+        const Registers actual = replayed.get_registers();
+        for (size_t i = 0; i < expected.size(); i++)
+            if (actual[i] != expected[i])
+                errx(EXIT_FAILURE, "replay: %s = 0x%x, expected 0x%x with %s %s",
+                     Register(i).get_name().c_str(), actual[i], expected[i], assignments[0], assignments[1]);
+    }
+}
+
+struct Case {
+    const char* name;
+    std::function<void(const Checkpoint&)> run;
+};
+
+const Case cases[] = {
+    { "decode_cache", test_decode_cache },
+    { "engines", test_engines },
+    { "checkpoint", test_checkpoint },
+    { "stack_distance", test_stack_distance },
+    { "perfsim", test_perfsim },
+    { "trace", test_trace },
+    { "replay", test_replay },
+    { "warm_up", test_warm_up },
+    { "branch_warm_up", test_branch_warm_up },
+};
+
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3)
+        errx(EXIT_FAILURE, "Required arguments (1):CASE (2):FILE_NAME");
+
+    Checkpoint program = Checkpoint::load_program(argv[2]);
+    for (const auto& item : cases) {
+        if (strcmp(item.name, argv[1]) == 0) {
+            item.run(program);
+            std::cout << item.name << ": OK" << std::endl;
+            return 0;
+        }
+    }
+    errx(EXIT_FAILURE, "Unknown case: %s", argv[1]);
+}
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include "../../src/elf_manager.h"
 
@@ -6,11 +8,15 @@ int main(int argc, char* argv[]) {
         errx(EXIT_FAILURE, "Miss arg: name of ELF file");
     ElfManager em(argv[1]);
     auto PC = em.getPC();
-    auto words = em.getWords();
     std::cout << PC << std::endl;
-    for (size_t i = 0; i < words.size(); i++) {
-        std::cout << std::hex << words[i] << " ";
+    for (const auto& segment : em.getSegments()) {
+        std::cout << std::hex << segment.vaddr << ":";
+        for (uint32_t offset = 0; offset < segment.file_size; offset += 4) {
+            uint32_t word = 0;
+            std::memcpy(&word, segment.bytes + offset, std::min(4u, segment.file_size - offset));
+            std::cout << " " << word;
+        }
+        std::cout << std::dec << std::endl;
     }
-    std::cout << std::endl;
     return 0;
 }